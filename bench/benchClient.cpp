@@ -0,0 +1,62 @@
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include <catch2/catch.hpp>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <Client.hpp>
+#include <Listener.hpp>
+
+// Each benchmark pushes one serialized table to DATAGRAMS targets, datagrams/sec
+// is DATAGRAMS divided by the reported mean.
+constexpr int DATAGRAMS = 64;
+
+namespace {
+int send_socket_per_datagram(const char *msg, size_t size, const std::string &ip, const std::string &port) {
+  sockaddr_in servaddr{};
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  servaddr.sin_family = AF_INET;
+  servaddr.sin_addr.s_addr = inet_addr(ip.c_str());
+  servaddr.sin_port = htons(stoi(port));
+  auto r = sendto(fd, msg, size, 0, (sockaddr *) &servaddr, sizeof(servaddr));
+  close(fd);
+  return r < 0 ? -2 : 0;
+}
+} // namespace
+
+TEST_CASE("Gossip sender datagrams/sec", "[benchmark][client]") {
+  gossip::Listener server;
+  auto sink = server.create_connection("127.0.0.1", "5101");
+
+  std::vector<gossip::Peer> peers;
+  for (int i = 0; i < 16; ++i) {
+    peers.emplace_back(std::to_string(i), "127.0.0.1:" + std::to_string(5200 + i));
+  }
+  gossip::Client client{};
+  msgpack::sbuffer sbuf;
+  auto s = client.serialize(sbuf, peers);
+  std::vector<std::string> targets(DATAGRAMS, "127.0.0.1:5101");
+
+  BENCHMARK("socket per datagram x64") {
+    int r = 0;
+    for (int i = 0; i < DATAGRAMS; ++i) {
+      r += send_socket_per_datagram(sbuf.data(), s, "127.0.0.1", "5101");
+    }
+    return r;
+  };
+
+  BENCHMARK("persistent socket sendto x64") {
+    int r = 0;
+    for (int i = 0; i < DATAGRAMS; ++i) {
+      r += client.send_members(sbuf.data(), s, "127.0.0.1", "5101");
+    }
+    return r;
+  };
+
+  BENCHMARK("persistent socket sendmmsg x64") {
+    return client.send_members(sbuf.data(), s, targets);
+  };
+
+  ::close(sink);
+}
@@ -0,0 +1,61 @@
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include <catch2/catch.hpp>
+#include <chrono>
+#include <Client.hpp>
+#include <Listener.hpp>
+
+// Decode throughput of one full datagram of peers into the table, by materializing a
+// vector of Peer objects and by streaming string views through the visitor.
+constexpr int ITERATIONS = 2000;
+
+namespace {
+template<typename Decode>
+double peers_per_sec(const msgpack::sbuffer &sbuf, gossip::Members &members, Decode decode) {
+  std::size_t peers = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < ITERATIONS; ++i) {
+    peers += decode(sbuf, members);
+  }
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  return peers/elapsed.count();
+}
+} // namespace
+
+TEST_CASE("Decode throughput", "[benchmark][decode]") {
+  std::vector<gossip::Peer> peers;
+  for (int i = 0; i < 10000; ++i) {
+    peers.emplace_back("node-" + std::to_string(i) + ".gspd.cluster.local", "127.0.0.1:5000");
+  }
+  gossip::Client client{};
+  msgpack::sbuffer sbuf;
+  client.serialize(sbuf, peers, 0, gossip::MAX_DATAGRAM);
+
+  gossip::Members members{};
+  for (auto &p : peers) {
+    members.add_peer(p);
+  }
+
+  auto deserialize = [](const msgpack::sbuffer &b, gossip::Members &m) {
+    auto decoded = gossip::Listener::deserialize(b.data(), b.size());
+    for (auto &p : decoded) {
+      m.heartbeat(p);
+    }
+    return decoded.size();
+  };
+  auto decode = [](const msgpack::sbuffer &b, gossip::Members &m) {
+    return gossip::Listener::decode(b.data(), b.size(),
+                                    [&](std::string_view id, std::string_view address, unsigned int hb) {
+                                      m.heartbeat(id, address, hb);
+                                    });
+  };
+
+  WARN("deserialize: " << peers_per_sec(sbuf, members, deserialize) << " peers/sec");
+  WARN("decode: " << peers_per_sec(sbuf, members, decode) << " peers/sec");
+
+  BENCHMARK("deserialize") {
+    return deserialize(sbuf, members);
+  };
+  BENCHMARK("decode") {
+    return decode(sbuf, members);
+  };
+}
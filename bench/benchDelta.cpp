@@ -0,0 +1,63 @@
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include <catch2/catch.hpp>
+#include <unistd.h>
+#include <Client.hpp>
+#include <Listener.hpp>
+
+// Bytes per round for a node with PEERS members of which CHANGED get a new heartbeat
+// every round, gossiping to 3 targets in full table and in delta mode.
+constexpr int PEERS = 512;
+constexpr int CHANGED = 16;
+constexpr int ROUNDS = 100;
+
+namespace {
+double bytes_per_round(unsigned int full_sync_rounds) {
+  gossip::Listener server;
+  auto sink = server.create_connection("127.0.0.1", "5130");
+
+  gossip::Members members{};
+  std::vector<gossip::Peer> peers;
+  for (int i = 0; i < PEERS; ++i) {
+    peers.emplace_back("node-" + std::to_string(i) + ".gspd.cluster.local", "127.0.0.1:5130");
+    members.add_peer(peers.back());
+  }
+
+  gossip::Client client{};
+  gossip::DeltaSync delta{full_sync_rounds};
+  // Past the startup rounds, where the window still covers the whole table
+  for (int round = 0; round < 4; ++round) {
+    delta.begin_round(members);
+  }
+  std::vector<gossip::Peer> k;
+  std::vector<gossip::Peer> table;
+  msgpack::sbuffer sbuf;
+  for (int round = 0; round < ROUNDS; ++round) {
+    for (int i = 0; i < CHANGED; ++i) {
+      auto &p = peers[(round*CHANGED + i)%PEERS];
+      p.inc_heartbeat();
+      members.heartbeat(p);
+    }
+    members.get_random_peers(3, k);
+    if (delta.begin_round(members)) {
+      members.get_alive_peers(table);
+    } else {
+      delta.next(members, table);
+    }
+    client.send_table(sbuf, table, k, gossip::MAX_DATAGRAM);
+  }
+  ::close(sink);
+  return static_cast<double>(client.bytes_sent())/ROUNDS;
+}
+} // namespace
+
+TEST_CASE("Gossip bytes per round, full table vs delta", "[benchmark][delta]") {
+  WARN("full table: " << bytes_per_round(1) << " bytes/round");
+  WARN("delta, full sync every 10: " << bytes_per_round(10) << " bytes/round");
+
+  BENCHMARK("full table 100 rounds") {
+    return bytes_per_round(1);
+  };
+  BENCHMARK("delta 100 rounds") {
+    return bytes_per_round(10);
+  };
+}
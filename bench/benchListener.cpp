@@ -0,0 +1,69 @@
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include <catch2/catch.hpp>
+#include <Client.hpp>
+#include <Listener.hpp>
+
+// Loopback ingest: SENDERS clients, each with its own source port so SO_REUSEPORT spreads
+// them over the pool, push DATAGRAMS tables of PEERS entries into Members::heartbeat.
+constexpr int SENDERS = 8;
+constexpr int DATAGRAMS = 2000;
+constexpr int PEERS = 32;
+
+namespace {
+void ingest(std::size_t workers, const std::string &port, Catch::Benchmark::Chronometer meter) {
+  gossip::Members members{};
+  std::atomic<std::uint64_t> handled{0};
+  gossip::ListenerPool pool{workers, 64, 2048};
+  pool.start("127.0.0.1", port, 8 << 20, [&](const char *buf, std::size_t len) {
+    for (auto &p : gossip::Listener::deserialize(buf, len)) {
+      members.heartbeat(p);
+    }
+    handled.fetch_add(1);
+  });
+
+  unsigned int hb = 1;
+  meter.measure([&] {
+    ++hb;
+    std::vector<gossip::Peer> peers;
+    for (int i = 0; i < PEERS; ++i) {
+      peers.emplace_back(std::to_string(i) + "-peer-with-a-longer-id", "127.0.0.1:" + std::to_string(6000 + i));
+      peers.back().heartbeat(hb);
+    }
+    auto start = pool.received() + pool.dropped();
+    std::vector<std::thread> senders;
+    for (int s = 0; s < SENDERS; ++s) {
+      senders.emplace_back([&] {
+        gossip::Client client{};
+        msgpack::sbuffer sbuf;
+        auto size = client.serialize(sbuf, peers);
+        std::vector<std::string> targets(64, "127.0.0.1:" + port);
+        for (int i = 0; i < DATAGRAMS/64; ++i) {
+          client.send_members(sbuf.data(), size, targets);
+        }
+      });
+    }
+    for (auto &t : senders) {
+      t.join();
+    }
+    auto expected = start + SENDERS*(DATAGRAMS/64)*64;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+    while (pool.received() + pool.dropped() < expected && std::chrono::steady_clock::now() < deadline) {
+      std::this_thread::yield();
+    }
+    return handled.load();
+  });
+  pool.stop();
+}
+} // namespace
+
+TEST_CASE("Listener pool ingest scaling", "[benchmark][listener]") {
+  BENCHMARK_ADVANCED("ingest 1 worker")(Catch::Benchmark::Chronometer meter) {
+    ingest(1, "5110", meter);
+  };
+  BENCHMARK_ADVANCED("ingest 2 workers")(Catch::Benchmark::Chronometer meter) {
+    ingest(2, "5111", meter);
+  };
+  BENCHMARK_ADVANCED("ingest 4 workers")(Catch::Benchmark::Chronometer meter) {
+    ingest(4, "5112", meter);
+  };
+}
@@ -0,0 +1,132 @@
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include <catch2/catch.hpp>
+#include <thread>
+#include <gossip.hpp>
+
+// WRITERS threads heartbeat PEERS peers ROUNDS times while READERS threads take
+// alive/suspected snapshots, the mix seen from listener, sender, cleanup and /status.
+constexpr int PEERS = 2048;
+constexpr int ROUNDS = 8;
+constexpr int READERS = 2;
+
+namespace {
+void contend(int writers, Catch::Benchmark::Chronometer meter) {
+  gossip::Members members{};
+  std::vector<gossip::Peer> peers;
+  for (int i = 0; i < PEERS; ++i) {
+    peers.emplace_back(std::to_string(i) + "-peer", "127.0.0.1:" + std::to_string(6000 + i%1000));
+    members.add_peer(peers.back());
+  }
+
+  unsigned int hb = 1;
+  meter.measure([&] {
+    hb += ROUNDS;
+    std::atomic<bool> done{false};
+    std::atomic<std::size_t> snapshots{0};
+    std::vector<std::thread> readers;
+    for (int r = 0; r < READERS; ++r) {
+      readers.emplace_back([&] {
+        while (!done.load()) {
+          snapshots += members.get_alive_peers().size() + members.get_suspected_peers().size();
+        }
+      });
+    }
+    std::vector<std::thread> threads;
+    for (int w = 0; w < writers; ++w) {
+      threads.emplace_back([&, w] {
+        auto p = peers;
+        for (int round = 0; round < ROUNDS; ++round) {
+          for (std::size_t i = w; i < p.size(); i += writers) {
+            p[i].heartbeat(hb + round);
+            members.heartbeat(p[i]);
+          }
+        }
+      });
+    }
+    for (auto &t : threads) {
+      t.join();
+    }
+    done.store(true);
+    for (auto &t : readers) {
+      t.join();
+    }
+    return snapshots.load();
+  });
+}
+} // namespace
+
+TEST_CASE("Members table contention", "[benchmark][members]") {
+  BENCHMARK_ADVANCED("heartbeat 1 writer, 2 readers")(Catch::Benchmark::Chronometer meter) {
+    contend(1, meter);
+  };
+  BENCHMARK_ADVANCED("heartbeat 4 writers, 2 readers")(Catch::Benchmark::Chronometer meter) {
+    contend(4, meter);
+  };
+  BENCHMARK_ADVANCED("heartbeat 8 writers, 2 readers")(Catch::Benchmark::Chronometer meter) {
+    contend(8, meter);
+  };
+}
+
+TEST_CASE("Members snapshot of 10k peers", "[benchmark][members]") {
+  gossip::Members members{};
+  for (int i = 0; i < 10000; ++i) {
+    gossip::Peer p{std::to_string(i) + "-peer", "127.0.0.1:" + std::to_string(6000 + i%1000)};
+    members.add_peer(p);
+  }
+
+  BENCHMARK("get_alive_peers 10k") {
+    return members.get_alive_peers();
+  };
+  BENCHMARK("get_random_peers 3 of 10k") {
+    return members.get_random_peers(3);
+  };
+  std::vector<gossip::Peer> k;
+  BENCHMARK("get_random_peers 3 of 10k, reused output") {
+    members.get_random_peers(3, k);
+    return k.size();
+  };
+  gossip::RoundRobin rr;
+  BENCHMARK("round robin 3 of 10k") {
+    rr.next(members, 3, k);
+    return k.size();
+  };
+}
+
+namespace {
+// One cleanup tick of a table of n peers, none of them due, against the full table
+// scan a polling detector does every tick.
+void deadline_tick(int n) {
+  gossip::Members members{};
+  members.set_tfail(3600*1000);
+  for (int i = 0; i < n; ++i) {
+    gossip::Peer p{std::to_string(i) + "-peer", "127.0.0.1:" + std::to_string(6000 + i%1000)};
+    members.add_peer(p);
+  }
+
+  std::string name = std::to_string(n/1000) + "k";
+  BENCHMARK("cleanup_task " + name + ", nothing due") {
+    members.cleanup_task();
+  };
+  BENCHMARK("full scan " + name) {
+    auto now = std::chrono::steady_clock::now();
+    int due = 0;
+    for (const auto &p : members.get_alive_peers()) {
+      due += p.get_timestamp() + std::chrono::hours(1) < now;
+    }
+    return due;
+  };
+}
+} // namespace
+
+TEST_CASE("Failure detection cost per tick", "[benchmark][members]") {
+  deadline_tick(10000);
+  deadline_tick(100000);
+
+  timer::TimerWheel wheel{std::chrono::milliseconds(1), 8192};
+  auto now = timer::TimerWheel::clock::now();
+  timer::TimerWheel::id_t id = 0;
+  BENCHMARK("schedule or reschedule one of 100k") {
+    wheel.schedule(id, now + std::chrono::milliseconds(id%8000));
+    id = (id + 1)%100000;
+  };
+}
@@ -0,0 +1,46 @@
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include <catch2/catch.hpp>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "Metrics.hpp"
+
+// Every thread adds ADDS times to one counter, as listener workers counting the same
+// event do.
+constexpr int ADDS = 1 << 22;
+
+namespace {
+template<typename Add>
+double adds_per_sec(int threads, Add add) {
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> workers;
+  for (int t = 0; t < threads; ++t) {
+    workers.emplace_back([&] {
+      for (int i = 0; i < ADDS; ++i) {
+        add();
+      }
+    });
+  }
+  for (auto &w : workers) {
+    w.join();
+  }
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  return threads*double(ADDS)/elapsed.count();
+}
+} // namespace
+
+TEST_CASE("Counter add throughput", "[benchmark][metrics]") {
+  for (int threads : {1, 4}) {
+    std::atomic<std::uint64_t> shared{0};
+    WARN("shared atomic " << threads << " threads: "
+             << adds_per_sec(threads, [&shared] { shared.fetch_add(1, std::memory_order_relaxed); }) << " adds/sec");
+    gossip::Counter c;
+    WARN("Counter " << threads << " threads: " << adds_per_sec(threads, [&c] { c.add(); }) << " adds/sec");
+  }
+
+  gossip::Histogram h;
+  BENCHMARK("Histogram observe") {
+    h.observe(std::chrono::microseconds(300));
+  };
+}
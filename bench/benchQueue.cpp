@@ -0,0 +1,80 @@
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include <catch2/catch.hpp>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <BoundedQueue.hpp>
+#include <ConcurentQueue.hpp>
+
+// Hand ITEMS integers from producer threads to consumer threads through each queue,
+// with blocking push and pop on both sides.
+constexpr int ITEMS = 1 << 20;
+
+namespace {
+template<typename Queue>
+double items_per_sec(Queue &q, int producers, int consumers) {
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for (int p = 0; p < producers; ++p) {
+    threads.emplace_back([&] {
+      for (int i = 0; i < ITEMS/producers; ++i) {
+        q.push(i);
+      }
+    });
+  }
+  for (int c = 0; c < consumers; ++c) {
+    threads.emplace_back([&] {
+      for (int i = 0; i < ITEMS/consumers; ++i) {
+        q.pop();
+      }
+    });
+  }
+  for (auto &t : threads) {
+    t.join();
+  }
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  return ITEMS/elapsed.count();
+}
+} // namespace
+
+TEST_CASE("Queue hand-off throughput", "[benchmark][queue]") {
+  {
+    container::ConcurrentQueue<int> q;
+    WARN("ConcurrentQueue 1:1: " << items_per_sec(q, 1, 1) << " items/sec");
+  }
+  {
+    container::BoundedQueue<int> q{1024};
+    WARN("BoundedQueue mpmc 1:1: " << items_per_sec(q, 1, 1) << " items/sec");
+  }
+  {
+    container::BoundedQueue<int, container::spsc> q{1024};
+    WARN("BoundedQueue spsc 1:1: " << items_per_sec(q, 1, 1) << " items/sec");
+  }
+  {
+    container::ConcurrentQueue<int> q;
+    WARN("ConcurrentQueue 4:4: " << items_per_sec(q, 4, 4) << " items/sec");
+  }
+  {
+    container::BoundedQueue<int> q{1024};
+    WARN("BoundedQueue mpmc 4:4: " << items_per_sec(q, 4, 4) << " items/sec");
+  }
+}
+
+TEST_CASE("Queue uncontended push and pop", "[benchmark][queue]") {
+  container::ConcurrentQueue<int> unbounded;
+  container::BoundedQueue<int> mpmc{1024};
+  container::BoundedQueue<int, container::spsc> spsc{1024};
+
+  BENCHMARK("ConcurrentQueue") {
+    unbounded.push(1);
+    return unbounded.pop();
+  };
+  BENCHMARK("BoundedQueue mpmc") {
+    mpmc.push(1);
+    return mpmc.pop();
+  };
+  BENCHMARK("BoundedQueue spsc") {
+    spsc.push(1);
+    return spsc.pop();
+  };
+}
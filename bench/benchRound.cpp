@@ -0,0 +1,72 @@
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include <catch2/catch.hpp>
+#include <atomic>
+#include <new>
+#include <unistd.h>
+#include <Client.hpp>
+#include <Listener.hpp>
+
+// Counts every heap allocation in the benchmarks binary, read around one gossip round.
+namespace {
+std::atomic<std::size_t> allocations{0};
+} // namespace
+
+void *operator new(std::size_t size) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  if (auto p = std::malloc(size)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept {
+  std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept {
+  std::free(p);
+}
+
+// One round as seen by a node with PEERS members: ingest one received table,
+// run the failure detector, pick 3 targets and send them the table.
+constexpr int PEERS = 256;
+
+TEST_CASE("Allocations per gossip round", "[benchmark][round]") {
+  gossip::Listener server;
+  auto sink = server.create_connection("127.0.0.1", "5120");
+
+  gossip::Members members{};
+  gossip::Peer me{"me", "127.0.0.1:5120"};
+  members.set_me("me");
+  members.add_peer(me);
+  std::vector<gossip::Peer> received;
+  for (int i = 0; i < PEERS; ++i) {
+    received.emplace_back("node-" + std::to_string(i) + ".gspd.cluster.local", "127.0.0.1:5120");
+    members.add_peer(received.back());
+  }
+  gossip::Client client{};
+  const char msg[] = "table";
+
+  unsigned int hb = 1;
+  auto round = [&] {
+    ++hb;
+    for (auto &p : received) {
+      p.heartbeat(hb);
+      members.heartbeat(p);
+    }
+    members.cleanup_task();
+    auto k = members.get_random_peers(3);
+    return client.send_to_peers(msg, sizeof(msg), k);
+  };
+
+  round();
+  auto before = allocations.load();
+  round();
+  WARN("allocations per round with " << PEERS << " peers: " << allocations.load() - before);
+
+  BENCHMARK("gossip round") {
+    return round();
+  };
+
+  ::close(sink);
+}
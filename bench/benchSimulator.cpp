@@ -0,0 +1,70 @@
+#include <catch2/catch.hpp>
+#include <chrono>
+#include <initializer_list>
+#include <spdlog/spdlog.h>
+#include "Simulator.hpp"
+
+using namespace std::chrono_literals;
+
+// Whole clusters on the deterministic simulator. Each run reports the convergence of
+// heartbeat increments, how long until every node suspected a few crashed ones, the
+// false positive rate and the bandwidth each node sends. Full table gossip costs
+// O(N^2) per round and every node holds the whole table, so the sweeps run 256 nodes
+// and one run covers 1000.
+namespace {
+void report(const gossip::sim::Options &o, const gossip::sim::Report &r) {
+  using gossip::sim::Report;
+  WARN(o.nodes << " nodes, fanout " << o.fanout << ", tround " << o.tround.count() << "ms, loss "
+               << o.loss << ", latency " << o.latency.count() << "us+" << o.jitter.count()
+               << "us: " << r.convergence.size() << "/" << r.increments << " increments converged, p50 "
+               << Report::percentile(r.convergence, 0.5) << "ms, p99 "
+               << Report::percentile(r.convergence, 0.99) << "ms, max "
+               << Report::percentile(r.convergence, 1) << "ms, delay " << r.dissemination_delay
+               << "ms over " << r.dissemination_hops << " hops, detection p50 "
+               << Report::percentile(r.detection, 0.5) << "ms of " << r.detection.size()
+               << ", false positive rate " << r.false_positive_rate << ", "
+               << r.bytes_per_node_per_second << " bytes/node/s");
+}
+
+gossip::sim::Report simulate(const gossip::sim::Options &o) {
+  // Every node logs its suspicion of every crashed node
+  spdlog::set_level(spdlog::level::warn);
+  gossip::sim::Cluster cluster(o);
+  for (std::size_t i = 0; i < 4; ++i) {
+    cluster.crash(i*o.nodes/4, 1s);
+  }
+  return cluster.run(3s);
+}
+} // namespace
+
+TEST_CASE("Simulated cluster convergence", "[benchmark][simulator]") {
+  for (auto[fanout, tround] : {std::pair{1u, 150}, std::pair{3u, 150}, std::pair{5u, 150}, std::pair{3u, 500}}) {
+    gossip::sim::Options o;
+    o.nodes = 256;
+    o.fanout = fanout;
+    o.tround = std::chrono::milliseconds(tround);
+    auto r = simulate(o);
+    REQUIRE(!r.convergence.empty());
+    report(o, r);
+  }
+}
+
+TEST_CASE("Simulated cluster on a lossy network", "[benchmark][simulator]") {
+  for (auto[loss, jitter] : {std::pair{0.01, 1000us}, std::pair{0.05, 5000us}, std::pair{0.2, 20000us}}) {
+    gossip::sim::Options o;
+    o.nodes = 256;
+    o.loss = loss;
+    o.latency = 2ms;
+    o.jitter = jitter;
+    auto r = simulate(o);
+    REQUIRE(!r.convergence.empty());
+    report(o, r);
+  }
+}
+
+TEST_CASE("Simulated cluster of 1000 nodes", "[benchmark][simulator]") {
+  gossip::sim::Options o;
+  auto r = simulate(o);
+  REQUIRE(!r.convergence.empty());
+  report(o, r);
+}
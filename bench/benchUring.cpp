@@ -0,0 +1,77 @@
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include <catch2/catch.hpp>
+#include <sys/resource.h>
+#include <chrono>
+#include <thread>
+#include <Client.hpp>
+#include <Listener.hpp>
+#include <Uring.hpp>
+
+// Loopback throughput of one sender and one receiving worker, with recvmmsg/sendmmsg
+// and with io_uring. CPU time is user plus system of the whole process, so both sides
+// of the loopback are counted.
+constexpr int DATAGRAMS = 200000;
+constexpr int BATCH = 64;
+
+namespace {
+struct Result {
+  double datagrams_per_sec;
+  double cpu_us_per_datagram;
+  std::uint64_t received;
+};
+
+double cpu_seconds() {
+  rusage usage{};
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec)/1e6;
+}
+
+Result loopback(bool io_uring, const std::string &port) {
+  gossip::ListenerPool pool{1, BATCH, 2048};
+  if (io_uring) {
+    pool.use_io_uring();
+  }
+  pool.start("127.0.0.1", port, 8 << 20, [](const char *, std::size_t) {});
+
+  gossip::Client client{};
+  if (io_uring) {
+    client.use_io_uring();
+  }
+  std::vector<gossip::Peer> peers;
+  for (int i = 0; i < 16; ++i) {
+    peers.emplace_back("node-" + std::to_string(i), "127.0.0.1:" + std::to_string(6000 + i));
+  }
+  msgpack::sbuffer sbuf;
+  auto size = client.serialize(sbuf, peers);
+  std::vector<std::string> targets(BATCH, "127.0.0.1:" + port);
+
+  auto cpu = cpu_seconds();
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < DATAGRAMS/BATCH; ++i) {
+    client.send_members(sbuf.data(), size, targets);
+  }
+  std::uint64_t expected = DATAGRAMS/BATCH*BATCH;
+  auto deadline = start + std::chrono::seconds(10);
+  while (pool.received() + pool.dropped() < expected && std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::yield();
+  }
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  cpu = cpu_seconds() - cpu;
+  auto received = pool.received();
+  pool.stop();
+  return {received/elapsed.count(), cpu*1e6/received, received};
+}
+} // namespace
+
+TEST_CASE("io_uring against recvmmsg/sendmmsg", "[benchmark][uring]") {
+  auto syscalls = loopback(false, "5120");
+  WARN("syscalls: " << syscalls.datagrams_per_sec << " datagrams/sec, " << syscalls.cpu_us_per_datagram
+                    << " us CPU/datagram, " << syscalls.received << " received");
+  if (!gossip::uring::available()) {
+    WARN("io_uring: built without liburing");
+    return;
+  }
+  auto uring = loopback(true, "5121");
+  WARN("io_uring: " << uring.datagrams_per_sec << " datagrams/sec, " << uring.cpu_us_per_datagram
+                    << " us CPU/datagram, " << uring.received << " received");
+}
@@ -0,0 +1,65 @@
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include <catch2/catch.hpp>
+#include <Client.hpp>
+#include <Listener.hpp>
+
+// Bytes and datagrams needed for a PEERS table in the legacy msgpack and the compact
+// wire format, with cluster style ids and IPv4 addresses.
+constexpr int PEERS = 10000;
+
+namespace {
+// A table snapshot as the sender gets it, with address handles set
+std::vector<gossip::Peer> make_table(gossip::Members &members) {
+  for (int i = 0; i < PEERS; ++i) {
+    gossip::Peer p{"node-" + std::to_string(i) + ".gspd.cluster.local",
+                   "10.0." + std::to_string(i/256) + "." + std::to_string(i%256) + ":5000"};
+    p.heartbeat(i*1000);
+    members.add_peer(p);
+  }
+  std::vector<gossip::Peer> peers;
+  members.get_alive_peers(peers);
+  return peers;
+}
+
+std::pair<std::size_t, int> table_size(gossip::Client &client, const std::vector<gossip::Peer> &peers) {
+  msgpack::sbuffer sbuf;
+  std::size_t bytes = 0;
+  int datagrams = 0;
+  std::size_t first = 0;
+  while (first < peers.size()) {
+    sbuf.clear();
+    first = client.serialize(sbuf, peers, first, gossip::MAX_DATAGRAM);
+    bytes += sbuf.size();
+    ++datagrams;
+  }
+  return {bytes, datagrams};
+}
+} // namespace
+
+TEST_CASE("Wire format size, legacy vs compact", "[benchmark][wire]") {
+  gossip::Members members{};
+  auto peers = make_table(members);
+  gossip::Client legacy{};
+  gossip::Client compact{peers.front().get_id(), 2};
+
+  auto[legacy_bytes, legacy_datagrams] = table_size(legacy, peers);
+  auto[compact_bytes, compact_datagrams] = table_size(compact, peers);
+  WARN("legacy: " << legacy_bytes << " bytes in " << legacy_datagrams << " datagrams, "
+                  << static_cast<double>(legacy_bytes)/PEERS << " bytes/peer");
+  WARN("compact: " << compact_bytes << " bytes in " << compact_datagrams << " datagrams, "
+                   << static_cast<double>(compact_bytes)/PEERS << " bytes/peer");
+
+  BENCHMARK("legacy encode") {
+    return table_size(legacy, peers);
+  };
+  BENCHMARK("compact encode") {
+    return table_size(compact, peers);
+  };
+
+  msgpack::sbuffer sbuf;
+  compact.serialize(sbuf, peers, 0, gossip::MAX_DATAGRAM);
+  BENCHMARK("compact decode") {
+    return gossip::Listener::decode(sbuf.data(), sbuf.size(),
+                                    [](std::string_view, std::string_view, unsigned int) {});
+  };
+}
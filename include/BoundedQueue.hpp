@@ -0,0 +1,339 @@
+#pragma once
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace container {
+// Concurrency of a BoundedQueue, spsc trades the compare and swap loops of mpmc for
+// plain loads and stores when exactly one thread pushes and one thread pops.
+struct mpmc {};
+struct spsc {};
+
+namespace detail {
+constexpr std::size_t CACHE_LINE = 64;
+
+inline std::size_t round_pow2(std::size_t n) {
+  std::size_t p = 2;
+  while (p < n) {
+    p <<= 1;
+  }
+  return p;
+}
+
+// Event count over a futex. A waiter calls prepare, checks its condition once more and
+// only then waits, so a notify between the check and the wait is not lost. The low bit
+// of the epoch says somebody waits, the first notify clears it with the wake up and
+// the ones after cost a fence and a load until somebody waits again.
+class Signal {
+public:
+  std::uint32_t prepare() {
+    auto epoch = epoch_.fetch_or(1, std::memory_order_seq_cst) | 1;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    return epoch;
+  }
+
+  void wait(std::uint32_t epoch) {
+    syscall(SYS_futex, reinterpret_cast<std::uint32_t *>(&epoch_), FUTEX_WAIT_PRIVATE, epoch, nullptr, nullptr, 0);
+  }
+
+  void notify() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    auto epoch = epoch_.load(std::memory_order_relaxed);
+    if (!(epoch & 1)) {
+      return;
+    }
+    // Fails only when another notify already moved the epoch and woke everybody
+    if (epoch_.compare_exchange_strong(epoch, (epoch + 2) & ~1u, std::memory_order_seq_cst)) {
+      syscall(SYS_futex, reinterpret_cast<std::uint32_t *>(&epoch_), FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+    }
+  }
+
+private:
+  std::atomic<std::uint32_t> epoch_{0};
+};
+static_assert(sizeof(std::atomic<std::uint32_t>)==sizeof(std::uint32_t), "futex needs a plain 32 bit word");
+
+// Blocking operations shared by both queues, over their try_push and try_pop.
+template<typename Queue, typename T>
+class Blocking {
+public:
+  // Waits while the queue is full, which is the backpressure on producers.
+  void push(T item) {
+    auto &q = static_cast<Queue &>(*this);
+    while (!q.try_push(std::move(item))) {
+      auto epoch = not_full_.prepare();
+      if (q.try_push(std::move(item))) {
+        return;
+      }
+      not_full_.wait(epoch);
+    }
+  }
+
+  void pop(T &item) {
+    auto &q = static_cast<Queue &>(*this);
+    while (!q.try_pop(item)) {
+      auto epoch = not_empty_.prepare();
+      if (q.try_pop(item)) {
+        return;
+      }
+      not_empty_.wait(epoch);
+    }
+  }
+
+  T pop() {
+    T item;
+    pop(item);
+    return item;
+  }
+
+  // Waits for at least one item, then moves up to max of them to out.
+  template<typename OutputIt>
+  std::size_t pop(OutputIt out, std::size_t max) {
+    auto &q = static_cast<Queue &>(*this);
+    for (;;) {
+      if (auto n = q.try_pop(out, max)) {
+        return n;
+      }
+      auto epoch = not_empty_.prepare();
+      if (auto n = q.try_pop(out, max)) {
+        return n;
+      }
+      not_empty_.wait(epoch);
+    }
+  }
+
+protected:
+  Signal not_empty_;
+  Signal not_full_;
+};
+} // namespace detail
+
+// Fixed capacity lock-free ring. try_push fails when full and try_pop when empty,
+// neither allocates nor takes a lock. push and pop block on a futex instead. The
+// capacity is rounded up to a power of two.
+template<typename T, typename Concurrency = mpmc>
+class BoundedQueue;
+
+// Any number of producers and consumers. Every cell carries a sequence number telling
+// whether it holds the item of the current lap, so a thread claims a position with one
+// compare and swap and never waits for another one (Vyukov's bounded queue).
+template<typename T>
+class BoundedQueue<T, mpmc> : public detail::Blocking<BoundedQueue<T, mpmc>, T> {
+public:
+  explicit BoundedQueue(std::size_t capacity)
+      : mask_(detail::round_pow2(capacity) - 1), cells_(new Cell[mask_ + 1]) {
+    for (std::size_t i = 0; i <= mask_; ++i) {
+      cells_[i].seq.store(i, std::memory_order_relaxed);
+    }
+  }
+  BoundedQueue(const BoundedQueue &) = delete;
+  BoundedQueue &operator=(const BoundedQueue &) = delete;
+
+  ~BoundedQueue() {
+    T item;
+    while (try_pop(item)) {
+    }
+    delete[] cells_;
+  }
+
+  bool try_push(const T &item) {
+    return emplace(item);
+  }
+
+  bool try_push(T &&item) {
+    return emplace(std::move(item));
+  }
+
+  bool try_pop(T &item) {
+    return try_pop(&item, 1)==1;
+  }
+
+  // Moves up to max items to out with one compare and swap for the whole batch.
+  template<typename OutputIt>
+  std::size_t try_pop(OutputIt out, std::size_t max) {
+    auto pos = head_.load(std::memory_order_relaxed);
+    std::size_t n;
+    for (;;) {
+      // The batch is the run of filled cells from head, claimed all at once
+      n = 0;
+      while (n < max && cells_[(pos + n) & mask_].seq.load(std::memory_order_acquire)==pos + n + 1) {
+        ++n;
+      }
+      if (n==0) {
+        auto seq = cells_[pos & mask_].seq.load(std::memory_order_acquire);
+        if (static_cast<std::intptr_t>(seq - (pos + 1)) < 0) {
+          return 0;
+        }
+        pos = head_.load(std::memory_order_relaxed);
+        continue;
+      }
+      if (head_.compare_exchange_weak(pos, pos + n, std::memory_order_relaxed)) {
+        break;
+      }
+    }
+    for (std::size_t i = 0; i < n; ++i) {
+      auto &cell = cells_[(pos + i) & mask_];
+      auto value = cell.get();
+      *out = std::move(*value);
+      ++out;
+      value->~T();
+      cell.seq.store(pos + i + mask_ + 1, std::memory_order_release);
+    }
+    this->not_full_.notify();
+    return n;
+  }
+
+  std::size_t capacity() const {
+    return mask_ + 1;
+  }
+
+  // Only a hint while other threads push or pop.
+  std::size_t size() const {
+    auto tail = tail_.load(std::memory_order_relaxed);
+    auto head = head_.load(std::memory_order_relaxed);
+    return tail > head ? tail - head : 0;
+  }
+
+private:
+  struct Cell {
+    std::atomic<std::size_t> seq;
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+
+    T *get() {
+      return std::launder(reinterpret_cast<T *>(&storage));
+    }
+  };
+
+  const std::size_t mask_;
+  Cell *const cells_;
+  // On their own cache lines so producers and consumers do not invalidate each other
+  alignas(detail::CACHE_LINE) std::atomic<std::size_t> tail_{0};
+  alignas(detail::CACHE_LINE) std::atomic<std::size_t> head_{0};
+
+  template<typename U>
+  bool emplace(U &&item) {
+    auto pos = tail_.load(std::memory_order_relaxed);
+    Cell *cell;
+    for (;;) {
+      cell = &cells_[pos & mask_];
+      auto seq = cell->seq.load(std::memory_order_acquire);
+      auto diff = static_cast<std::intptr_t>(seq - pos);
+      if (diff==0) {
+        if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        // The cell still holds the item of the previous lap
+        return false;
+      } else {
+        pos = tail_.load(std::memory_order_relaxed);
+      }
+    }
+    new(&cell->storage) T(std::forward<U>(item));
+    cell->seq.store(pos + 1, std::memory_order_release);
+    this->not_empty_.notify();
+    return true;
+  }
+};
+
+// Exactly one producer thread and one consumer thread. Each side keeps a copy of the
+// other's index and reloads it only when the ring looks full or empty.
+template<typename T>
+class BoundedQueue<T, spsc> : public detail::Blocking<BoundedQueue<T, spsc>, T> {
+public:
+  explicit BoundedQueue(std::size_t capacity)
+      : mask_(detail::round_pow2(capacity) - 1), slots_(new Slot[mask_ + 1]) {}
+  BoundedQueue(const BoundedQueue &) = delete;
+  BoundedQueue &operator=(const BoundedQueue &) = delete;
+
+  ~BoundedQueue() {
+    T item;
+    while (try_pop(item)) {
+    }
+    delete[] slots_;
+  }
+
+  bool try_push(const T &item) {
+    return emplace(item);
+  }
+
+  bool try_push(T &&item) {
+    return emplace(std::move(item));
+  }
+
+  bool try_pop(T &item) {
+    return try_pop(&item, 1)==1;
+  }
+
+  // Moves up to max items to out, publishing the new head once for the batch.
+  template<typename OutputIt>
+  std::size_t try_pop(OutputIt out, std::size_t max) {
+    auto head = head_.load(std::memory_order_relaxed);
+    if (cached_tail_ - head < max) {
+      cached_tail_ = tail_.load(std::memory_order_acquire);
+    }
+    auto n = std::min(max, cached_tail_ - head);
+    if (n==0) {
+      return 0;
+    }
+    for (std::size_t i = 0; i < n; ++i) {
+      auto value = slots_[(head + i) & mask_].get();
+      *out = std::move(*value);
+      ++out;
+      value->~T();
+    }
+    head_.store(head + n, std::memory_order_release);
+    this->not_full_.notify();
+    return n;
+  }
+
+  std::size_t capacity() const {
+    return mask_ + 1;
+  }
+
+  std::size_t size() const {
+    return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
+  }
+
+private:
+  struct Slot {
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+
+    T *get() {
+      return std::launder(reinterpret_cast<T *>(&storage));
+    }
+  };
+
+  const std::size_t mask_;
+  Slot *const slots_;
+  // Producer side
+  alignas(detail::CACHE_LINE) std::atomic<std::size_t> tail_{0};
+  std::size_t cached_head_{0};
+  // Consumer side
+  alignas(detail::CACHE_LINE) std::atomic<std::size_t> head_{0};
+  std::size_t cached_tail_{0};
+
+  template<typename U>
+  bool emplace(U &&item) {
+    auto tail = tail_.load(std::memory_order_relaxed);
+    if (tail - cached_head_ > mask_) {
+      cached_head_ = head_.load(std::memory_order_acquire);
+      if (tail - cached_head_ > mask_) {
+        return false;
+      }
+    }
+    new(&slots_[tail & mask_].storage) T(std::forward<U>(item));
+    tail_.store(tail + 1, std::memory_order_release);
+    this->not_empty_.notify();
+    return true;
+  }
+};
+} // namespace container
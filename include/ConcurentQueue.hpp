@@ -14,7 +14,7 @@ public:
   T pop() {
     std::unique_lock<std::mutex> qlock(m_mutex);
     m_cond.wait(qlock, [this] { return !m_queue.empty(); });
-    auto item = m_queue.front();
+    auto item = std::move(m_queue.front());
     m_queue.pop();
     return item;
   }
@@ -22,7 +22,7 @@ public:
   void pop(T &item) {
     std::unique_lock<std::mutex> qlock(m_mutex);
     m_cond.wait(qlock, [this] { return !m_queue.empty(); });
-    item = m_queue.front();
+    item = std::move(m_queue.front());
     m_queue.pop();
   }
 
@@ -0,0 +1,236 @@
+#pragma once
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <vector>
+
+namespace timer {
+// Hashed timing wheel for timers identified by small dense integer ids, at most one
+// timer per id. schedule, reschedule and cancel are O(1) and do not allocate once the
+// id has been seen. advance is driven by the caller, a single thread can serve every
+// timer. Deadlines are rounded up to the tick so a timer never fires early.
+class TimerWheel {
+public:
+  using clock = std::chrono::steady_clock;
+  using id_t = std::uint32_t;
+
+  // Ticks count from start, deadlines are rounded against it. A wheel driven by a
+  // simulated clock starts at that clock's time so rounding does not depend on when
+  // it was built.
+  TimerWheel(std::chrono::milliseconds tick, std::size_t slots, clock::time_point start = clock::now())
+      : tick_(tick), start_(start), heads_(slots, none) {}
+  TimerWheel(const TimerWheel &) = delete;
+  TimerWheel &operator=(const TimerWheel &) = delete;
+
+  // Arms the timer of id, replacing its previous deadline if any. Returns true when it
+  // is due before the deadline the last watch returned, the watcher has to wake earlier.
+  bool schedule(id_t id, clock::time_point deadline) {
+    std::unique_lock<std::mutex> lock(m_);
+    if (id >= nodes_.size()) {
+      nodes_.resize(id + 1);
+    }
+    if (nodes_[id].slot!=none) {
+      unlink(id);
+    }
+    auto tick = std::max(tick_of(deadline), current_);
+    link(id, tick);
+    if (tick < waiting_for_) {
+      waiting_for_ = tick;
+      cv_.notify_one();
+      return true;
+    }
+    return false;
+  }
+
+  void cancel(id_t id) {
+    std::unique_lock<std::mutex> lock(m_);
+    if (id < nodes_.size() && nodes_[id].slot!=none) {
+      unlink(id);
+    }
+  }
+
+  // Moves the first tick to start, as if built then. Only while no timer is armed,
+  // their ticks count from the old start.
+  void restart(clock::time_point start) {
+    std::unique_lock<std::mutex> lock(m_);
+    assert(size_==0);
+    start_ = start;
+    current_ = 0;
+    earliest_ = 0;
+  }
+
+  bool scheduled(id_t id) const {
+    std::unique_lock<std::mutex> lock(m_);
+    return id < nodes_.size() && nodes_[id].slot!=none;
+  }
+
+  std::size_t size() const {
+    std::unique_lock<std::mutex> lock(m_);
+    return size_;
+  }
+
+  // When the next timer is due, or one turn of the wheel ahead when none is armed
+  // that soon. Rounded up to the tick.
+  clock::time_point next_deadline() const {
+    std::unique_lock<std::mutex> lock(m_);
+    return start_ + tick_*next_tick();
+  }
+
+  // next_deadline for a caller that sleeps on a timer of its own instead of calling
+  // wait. Until the next watch, schedule returns true for a timer due before it.
+  clock::time_point watch() {
+    std::unique_lock<std::mutex> lock(m_);
+    waiting_for_ = next_tick();
+    return start_ + tick_*waiting_for_;
+  }
+
+  // Blocks until the next timer is due or notify is called, following timers scheduled
+  // earlier in the meantime, so an advancing thread only wakes up when there is work.
+  void wait() {
+    std::unique_lock<std::mutex> lock(m_);
+    while (!woken_) {
+      waiting_for_ = next_tick();
+      if (cv_.wait_until(lock, start_ + tick_*waiting_for_)==std::cv_status::timeout) {
+        break;
+      }
+    }
+    woken_ = false;
+    waiting_for_ = 0;
+  }
+
+  void notify() {
+    std::unique_lock<std::mutex> lock(m_);
+    woken_ = true;
+    cv_.notify_one();
+  }
+
+  // Disarms every timer due at now and calls fn(id) for each, outside the lock so fn
+  // may schedule again. Called from one thread at a time. Returns the number of timers fired.
+  template<typename Function>
+  std::size_t advance(clock::time_point now, Function fn) {
+    {
+      std::unique_lock<std::mutex> lock(m_);
+      if (now < start_) {
+        return 0;
+      }
+      auto target = static_cast<std::uint64_t>((now - start_)/tick_);
+      if (target < current_) {
+        return 0;
+      }
+      // Past one turn every slot has been looked at, the rest only repeats slots
+      auto last = std::min<std::uint64_t>(target, current_ + heads_.size() - 1);
+      expired_.clear();
+      for (auto t = current_; t <= last; ++t) {
+        auto id = heads_[t%heads_.size()];
+        while (id!=none) {
+          auto next = nodes_[id].next;
+          if (nodes_[id].tick <= target) {
+            unlink(id);
+            expired_.push_back(id);
+          }
+          id = next;
+        }
+      }
+      current_ = target + 1;
+      fired_.swap(expired_);
+    }
+    for (auto id : fired_) {
+      fn(id);
+    }
+    return fired_.size();
+  }
+
+private:
+  static constexpr std::uint32_t none = std::numeric_limits<std::uint32_t>::max();
+  // Intrusive list node, one per id, linked into the slot of its tick
+  struct Node {
+    std::uint64_t tick{0};
+    std::uint32_t slot{none};
+    id_t prev{none};
+    id_t next{none};
+  };
+
+  std::chrono::milliseconds tick_;
+  clock::time_point start_;
+  // Next tick advance looks at
+  std::uint64_t current_{0};
+  std::vector<id_t> heads_;
+  std::vector<Node> nodes_;
+  std::vector<id_t> expired_;
+  // Only touched by the advancing thread, kept to reuse its capacity
+  std::vector<id_t> fired_;
+  std::size_t size_{0};
+  mutable std::mutex m_;
+  std::condition_variable cv_;
+  // Tick wait or the watcher sleeps until, 0 when nobody waits
+  std::uint64_t waiting_for_{0};
+  // No armed timer is due before it. Lowered by link, raised by next_tick to the tick
+  // it found, so next_tick starts where the last one stopped instead of at current_.
+  mutable std::uint64_t earliest_{0};
+  bool woken_{false};
+
+  // First tick from current_ on with a timer due in it, at most one turn ahead. Earlier
+  // slots can only hold timers of later turns, so the first slot with a match is the
+  // earliest.
+  std::uint64_t next_tick() const {
+    auto end = current_ + heads_.size();
+    if (size_==0) {
+      return end;
+    }
+    for (auto t = std::max(earliest_, current_); t < end; ++t) {
+      for (auto id = heads_[t%heads_.size()]; id!=none; id = nodes_[id].next) {
+        if (nodes_[id].tick==t) {
+          earliest_ = t;
+          return t;
+        }
+      }
+    }
+    earliest_ = end;
+    return end;
+  }
+
+  std::uint64_t tick_of(clock::time_point deadline) const {
+    if (deadline <= start_) {
+      return 0;
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - start_);
+    auto tick = std::chrono::duration_cast<std::chrono::nanoseconds>(tick_);
+    return static_cast<std::uint64_t>((elapsed.count() + tick.count() - 1)/tick.count());
+  }
+
+  void link(id_t id, std::uint64_t tick) {
+    auto slot = static_cast<std::uint32_t>(tick%heads_.size());
+    auto &n = nodes_[id];
+    n.tick = tick;
+    n.slot = slot;
+    n.prev = none;
+    n.next = heads_[slot];
+    if (n.next!=none) {
+      nodes_[n.next].prev = id;
+    }
+    heads_[slot] = id;
+    earliest_ = std::min(earliest_, tick);
+    ++size_;
+  }
+
+  void unlink(id_t id) {
+    auto &n = nodes_[id];
+    if (n.prev!=none) {
+      nodes_[n.prev].next = n.next;
+    } else {
+      heads_[n.slot] = n.next;
+    }
+    if (n.next!=none) {
+      nodes_[n.next].prev = n.prev;
+    }
+    n.slot = none;
+    n.prev = none;
+    n.next = none;
+    --size_;
+  }
+};
+} // namespace timer
@@ -1,33 +1,285 @@
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <algorithm>
+#include <cstring>
+#include <limits>
 #include "Client.hpp"
+#include "Wire.hpp"
 #include "spdlog/spdlog.h"
 #include "spdlog/fmt/ostr.h"
 
 namespace gossip {
 
-int Client::send_members(const char *msg, size_t size, const std::string &ip, const std::string &port) {
-  sockaddr_in servaddr;
-  int fd = socket(AF_INET, SOCK_DGRAM, 0);
-  if (fd < 0) {
+Client::Client() {
+  open_socket();
+}
+
+Client::Client(std::string sender, int wire_version)
+    : wire_version_(wire_version), sender_(std::move(sender)) {
+  open_socket();
+}
+
+Client::~Client() {
+  if (fd_ >= 0) {
+    ::close(fd_);
+  }
+}
+
+bool Client::open_socket() {
+  fd_ = socket(AF_INET, SOCK_DGRAM, 0);
+  if (fd_ < 0) {
     spdlog::error("cannot open socket");
-    return -1;
+    return false;
+  }
+  return true;
+}
+
+const sockaddr_in *Client::resolve(const std::string &address) {
+  auto it = endpoints_.find(address);
+  if (it!=endpoints_.end()) {
+    return &it->second;
   }
 
-  bzero(&servaddr, sizeof(servaddr));
+  auto sep = address.rfind(':');
+  if (sep==std::string::npos) {
+    spdlog::error("invalid address: {}", address);
+    return nullptr;
+  }
+  sockaddr_in servaddr{};
   servaddr.sin_family = AF_INET;
-  servaddr.sin_addr.s_addr = inet_addr(ip.c_str());
-  servaddr.sin_port = htons(stoi(port));
-  if (sendto(fd, msg, size, 0,
-             (sockaddr *) &servaddr, sizeof(servaddr)) < 0) {
+  if (inet_pton(AF_INET, address.substr(0, sep).c_str(), &servaddr.sin_addr)!=1) {
+    spdlog::error("invalid address: {}", address);
+    return nullptr;
+  }
+  servaddr.sin_port = htons(std::atoi(address.c_str() + sep + 1));
+  return &endpoints_.emplace(address, servaddr).first->second;
+}
+
+int Client::send_members(const char *msg, size_t size, const std::string &ip, const std::string &port) {
+  return send_to(msg, size, ip + ':' + port);
+}
+
+int Client::send_to(const char *msg, size_t size, const std::string &address) {
+  if (fd_ < 0 && !open_socket()) {
+    return -1;
+  }
+  auto servaddr = resolve(address);
+  if (servaddr==nullptr) {
+    return -2;
+  }
+  if (sendto(fd_, msg, size, 0,
+             reinterpret_cast<const sockaddr *>(servaddr), sizeof(*servaddr)) < 0) {
     spdlog::error("cannot send message");
-    close(fd);
     return -2;
   }
-  close(fd);
+  datagrams_sent_.fetch_add(1, std::memory_order_relaxed);
+  bytes_sent_.fetch_add(size, std::memory_order_relaxed);
   return 0;
 }
 
+const sockaddr_in *Client::resolve(const gossip::Peer &peer) {
+  auto h = peer.get_address_handle();
+  if (h==no_handle) {
+    return resolve(peer.get_address());
+  }
+  if (h >= handle_endpoints_.size()) {
+    handle_endpoints_.resize(h + 1, sockaddr_in{});
+  }
+  auto &servaddr = handle_endpoints_[h];
+  if (servaddr.sin_family!=AF_INET) {
+    auto resolved = resolve(peer.get_address());
+    if (resolved==nullptr) {
+      return nullptr;
+    }
+    servaddr = *resolved;
+  }
+  return &servaddr;
+}
+
+bool Client::use_io_uring() {
+  if (fd_ < 0 && !open_socket()) {
+    return false;
+  }
+  uring_ = uring::Sender::create(fd_, 256);
+  if (uring_==nullptr) {
+    spdlog::warn("io_uring is not available, sending with sendmmsg");
+    return false;
+  }
+  return true;
+}
+
+void Client::queue(const sockaddr_in *servaddr) {
+  if (servaddr==nullptr) {
+    return;
+  }
+  mmsghdr m{};
+  m.msg_hdr.msg_name = const_cast<sockaddr_in *>(servaddr);
+  m.msg_hdr.msg_namelen = sizeof(*servaddr);
+  msgs_.push_back(m);
+}
+
+int Client::send_queued(const char *msg, size_t size) {
+  iovec iov{const_cast<char *>(msg), size};
+  for (auto &m : msgs_) {
+    m.msg_hdr.msg_iov = &iov;
+    m.msg_hdr.msg_iovlen = 1;
+  }
+
+  if (uring_!=nullptr) {
+    auto n = uring_->send(msgs_);
+    if (n > 0) {
+      datagrams_sent_.fetch_add(n, std::memory_order_relaxed);
+      bytes_sent_.fetch_add(n*size, std::memory_order_relaxed);
+    }
+    return n;
+  }
+
+  std::size_t sent = 0;
+  while (sent < msgs_.size()) {
+    auto batch = std::min<std::size_t>(msgs_.size() - sent, UIO_MAXIOV);
+    auto n = sendmmsg(fd_, msgs_.data() + sent, batch, 0);
+    if (n < 0) {
+      spdlog::error("cannot send message");
+      return sent > 0 ? static_cast<int>(sent) : -2;
+    }
+    sent += n;
+    datagrams_sent_.fetch_add(n, std::memory_order_relaxed);
+    bytes_sent_.fetch_add(n*size, std::memory_order_relaxed);
+  }
+  return static_cast<int>(sent);
+}
+
+int Client::send_members(const char *msg, size_t size, const std::vector<std::string> &addresses) {
+  if (fd_ < 0 && !open_socket()) {
+    return -1;
+  }
+  msgs_.clear();
+  for (const auto &a : addresses) {
+    queue(resolve(a));
+  }
+  return send_queued(msg, size);
+}
+
+int Client::send_to_peers(const char *msg, size_t size, const std::vector<gossip::Peer> &peers) {
+  if (fd_ < 0 && !open_socket()) {
+    return -1;
+  }
+  msgs_.clear();
+  for (const auto &p : peers) {
+    queue(resolve(p));
+  }
+  return send_queued(msg, size);
+}
+
 std::size_t Client::serialize(msgpack::sbuffer &sbuf, const std::vector<gossip::Peer> &peers) {
+  if (wire_version_ >= wire::VERSION) {
+    serialize_compact(sbuf, peers, 0, std::numeric_limits<std::size_t>::max());
+    return sbuf.size();
+  }
   msgpack::pack(sbuf, peers);
   return sbuf.size();
 }
-} // namespace gossip
\ No newline at end of file
+
+namespace {
+// Upper bound of a msgpack str: 1 byte fixstr header up to 31 bytes, else str8/16/32
+std::size_t packed_str(std::size_t n) {
+  return n + (n < 32 ? 1 : n < 256 ? 2 : n < 65536 ? 3 : 5);
+}
+
+// Upper bound of one packed Peer: array header, id, address and a uint32 heartbeat
+std::size_t packed_peer(const gossip::Peer &p) {
+  return 1 + packed_str(p.get_id().size()) + packed_str(p.get_address().size()) + 5;
+}
+} // namespace
+
+std::size_t Client::serialize(msgpack::sbuffer &sbuf, const std::vector<gossip::Peer> &peers,
+                              std::size_t first, std::size_t max_size) {
+  if (wire_version_ >= wire::VERSION) {
+    return serialize_compact(sbuf, peers, first, max_size);
+  }
+  // Outer array header is at most 3 bytes below 65536 entries
+  std::size_t bytes = 3;
+  auto last = first;
+  while (last < peers.size() && bytes + packed_peer(peers[last]) <= max_size) {
+    bytes += packed_peer(peers[last]);
+    ++last;
+  }
+  if (last==first && first < peers.size()) {
+    spdlog::error("peer does not fit in a datagram: {}", peers[first].get_id());
+    return first + 1;
+  }
+
+  msgpack::packer<msgpack::sbuffer> pk(sbuf);
+  pk.pack_array(last - first);
+  for (auto i = first; i < last; ++i) {
+    pk.pack(peers[i]);
+  }
+  return last;
+}
+
+std::string_view Client::wire_address(const gossip::Peer &peer) {
+  auto h = peer.get_address_handle();
+  if (h!=no_handle && h >= wire_addresses_.size()) {
+    wire_addresses_.resize(h + 1);
+  }
+  auto &a = h==no_handle ? wire_address_ : wire_addresses_[h];
+  if (h==no_handle || a.empty()) {
+    a.resize(wire::max_address_size(peer.get_address()));
+    a.resize(wire::encode_address(a.data(), peer.get_address()));
+  }
+  return a;
+}
+
+std::size_t Client::serialize_compact(msgpack::sbuffer &sbuf, const std::vector<gossip::Peer> &peers,
+                                      std::size_t first, std::size_t max_size) {
+  auto traced = wire_version_==wire::VERSION_TRACED;
+  wire::encode_header(sbuf, sender_, traced);
+  auto last = first;
+  while (last < peers.size()) {
+    scratch_.resize(wire::max_peer_size(peers[last]));
+    auto n = wire::encode_peer(scratch_.data(), peers[last], sender_, wire_address(peers[last]), traced);
+    if (sbuf.size() + n > max_size) {
+      break;
+    }
+    sbuf.write(scratch_.data(), n);
+    ++last;
+  }
+  if (last==first && first < peers.size()) {
+    spdlog::error("peer does not fit in a datagram: {}", peers[first].get_id());
+    sbuf.clear();
+    return first + 1;
+  }
+  return last;
+}
+
+int Client::send_table(msgpack::sbuffer &sbuf, const std::vector<gossip::Peer> &table,
+                       const std::vector<gossip::Peer> &targets, std::size_t max_size) {
+  if (table.empty()) {
+    return 0;
+  }
+  int datagrams = 0;
+  std::size_t first = 0;
+  do {
+    sbuf.clear();
+    auto next = serialize(sbuf, table, first, max_size);
+    if (sbuf.size() > 0) {
+      auto n = send_to_peers(sbuf.data(), sbuf.size(), targets);
+      if (n < 0) {
+        return datagrams > 0 ? datagrams : n;
+      }
+      datagrams += n;
+    }
+    first = next;
+  } while (first < table.size());
+  return datagrams;
+}
+
+std::uint64_t Client::bytes_sent() const {
+  return bytes_sent_.load(std::memory_order_relaxed);
+}
+
+std::uint64_t Client::datagrams_sent() const {
+  return datagrams_sent_.load(std::memory_order_relaxed);
+}
+} // namespace gossip
@@ -1,11 +1,82 @@
 #pragma once
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
 #include <msgpack.hpp>
 #include "gossip.hpp"
+#include "Uring.hpp"
 
 namespace gossip {
+// Owns one long-lived UDP socket used for every outgoing gossip datagram.
+// Resolved endpoints are cached per "ip:port" address. Not thread-safe, it is
+// meant to be driven by a single sender thread.
 class Client {
 public:
+  Client();
+  // wire_version 2 sends the compact format of Wire.hpp with sender as the header id,
+  // 3 the same with heartbeat traces, 1 the legacy msgpack array every version
+  // understands.
+  Client(std::string sender, int wire_version);
+  ~Client();
+  Client(const Client &) = delete;
+  Client &operator=(const Client &) = delete;
+
   std::size_t serialize(msgpack::sbuffer &sbuf, const std::vector<gossip::Peer> &peers);
+  // Packs peers from first on into sbuf, stopping before the datagram would exceed
+  // max_size bytes. Returns the index of the first peer left out.
+  std::size_t serialize(msgpack::sbuffer &sbuf, const std::vector<gossip::Peer> &peers,
+                        std::size_t first, std::size_t max_size);
   int send_members(const char *msg, std::size_t size, const std::string &ip, const std::string &port);
+  // Sends one datagram to an "ip:port" address, returns 0 or a negative error.
+  int send_to(const char *msg, std::size_t size, const std::string &address);
+  // Sends the same buffer to every address with as few sendmmsg calls as possible.
+  // Returns the number of datagrams handed to the kernel or a negative error.
+  int send_members(const char *msg, std::size_t size, const std::vector<std::string> &addresses);
+  // Same as send_members, peers coming from a MembersTable are resolved by their address handle.
+  int send_to_peers(const char *msg, std::size_t size, const std::vector<gossip::Peer> &peers);
+  // Sends table to every target split into as many datagrams of at most max_size bytes
+  // as needed. Returns the number of datagrams handed to the kernel or a negative error.
+  int send_table(msgpack::sbuffer &sbuf, const std::vector<gossip::Peer> &table,
+                 const std::vector<gossip::Peer> &targets, std::size_t max_size);
+  const sockaddr_in *resolve(const std::string &address);
+  const sockaddr_in *resolve(const gossip::Peer &peer);
+  // Sends batches as io_uring sendmsg entries from now on. Returns false and keeps
+  // sendmmsg when built without liburing or the kernel has no support.
+  bool use_io_uring();
+
+  std::uint64_t bytes_sent() const;
+  std::uint64_t datagrams_sent() const;
+
+private:
+  int fd_{-1};
+  std::unordered_map<std::string, sockaddr_in> endpoints_;
+  // Indexed by address handle, sin_family is 0 until resolved. A deque keeps
+  // already queued pointers valid when it grows.
+  std::deque<sockaddr_in> handle_endpoints_;
+  std::vector<mmsghdr> msgs_;
+  std::unique_ptr<uring::Sender> uring_;
+  int wire_version_{1};
+  std::string sender_;
+  // One encoded peer of the compact format, reused between datagrams
+  std::vector<char> scratch_;
+  // Compact encoded addresses indexed by address handle, empty until first sent
+  std::vector<std::string> wire_addresses_;
+  std::string wire_address_;
+
+  std::atomic<std::uint64_t> bytes_sent_{0};
+  std::atomic<std::uint64_t> datagrams_sent_{0};
+
+  bool open_socket();
+  std::size_t serialize_compact(msgpack::sbuffer &sbuf, const std::vector<gossip::Peer> &peers,
+                                std::size_t first, std::size_t max_size);
+  std::string_view wire_address(const gossip::Peer &peer);
+  void queue(const sockaddr_in *servaddr);
+  int send_queued(const char *msg, std::size_t size);
 };
 } // namespace gossip
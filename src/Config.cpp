@@ -1,6 +1,9 @@
 #include <algorithm>
+#include <charconv>
+#include <limits>
 #include <sstream>
 #include "Config.hpp"
+#include "spdlog/spdlog.h"
 
 namespace gossip {
 
@@ -11,7 +14,10 @@ bool Config::init() {
   bool ok{false};
   ok = _set_my_id()
       && _set_address()
-      && _set_seeds();
+      && _set_seeds()
+      && _set_receive()
+      && _set_gossip()
+      && _set_detector();
   return ok;
 }
 
@@ -27,6 +33,50 @@ Config::peers_t Config::get_seeds() const {
   return seeds_;
 }
 
+int Config::get_recv_buffer() const {
+  return recv_buffer_;
+}
+
+int Config::get_recv_batch() const {
+  return recv_batch_;
+}
+
+int Config::get_listeners() const {
+  return listeners_;
+}
+
+std::string Config::get_io_backend() const {
+  return io_backend_;
+}
+
+int Config::get_full_sync_rounds() const {
+  return full_sync_rounds_;
+}
+
+int Config::get_mtu() const {
+  return mtu_;
+}
+
+int Config::get_wire_version() const {
+  return wire_version_;
+}
+
+std::string Config::get_peer_selection() const {
+  return peer_selection_;
+}
+
+std::string Config::get_failure_detector() const {
+  return failure_detector_;
+}
+
+double Config::get_phi_threshold() const {
+  return phi_threshold_;
+}
+
+int Config::get_swim_indirect() const {
+  return swim_indirect_;
+}
+
 bool Config::_set_my_id() {
   auto[val, ok] = _get_env(MY_ID);
   if(ok) {
@@ -53,6 +103,63 @@ bool Config::_set_seeds() {
   return ok;
 }
 
+// Optional, the defaults are kept when not set
+bool Config::_set_receive() {
+  _set_number(RECV_BUFFER, 0, std::numeric_limits<int>::max(), recv_buffer_);
+  _set_number(RECV_BATCH, 1, std::numeric_limits<int>::max(), recv_batch_);
+  _set_number(LISTENERS, 1, std::numeric_limits<int>::max(), listeners_);
+  // "io_uring" keeps receives and batched sends posted on io_uring, only in a build
+  // with the experimental GSPD_WITH_IO_URING backend. Otherwise "syscalls",
+  // recvmmsg/sendmmsg
+  auto[backend, backend_ok] = _get_env(IO_BACKEND);
+  if (backend_ok && backend=="io_uring") {
+#ifdef GSPD_IO_URING
+    io_backend_ = backend;
+#else
+    spdlog::warn("IO_BACKEND=io_uring needs a build with GSPD_WITH_IO_URING, using syscalls");
+#endif
+  }
+  return true;
+}
+
+// Optional, FULL_SYNC_ROUNDS 1 gossips the full table every round, N > 1 sends
+// recent deltas and the full table every N rounds
+bool Config::_set_gossip() {
+  _set_number(FULL_SYNC_ROUNDS, 1, std::numeric_limits<int>::max(), full_sync_rounds_);
+  // Largest datagram sent and received, must be the same on every node
+  _set_number(MTU, MIN_MTU, MAX_MTU, mtu_);
+  // Format sent, 1 legacy msgpack, 2 compact or 3 compact with heartbeat traces for
+  // convergence metrics. All are always received, switch to 2 or 3 once every node
+  // runs a version that decodes it
+  _set_number(WIRE_VERSION, 1, 3, wire_version_);
+  // Gossip targets, "random" samples every round, "round_robin" walks a shuffled order
+  // so every peer is contacted within N/k rounds
+  auto[selection, selection_ok] = _get_env(PEER_SELECTION);
+  if (selection_ok && (selection=="random" || selection=="round_robin")) {
+    peer_selection_ = selection;
+  }
+  return true;
+}
+
+// Optional, FAILURE_DETECTOR "fixed" suspects a peer a fixed timeout after its last
+// heartbeat, "phi" adapts the timeout to each peer's heartbeat intervals and suspects
+// it once phi reaches PHI_THRESHOLD. "swim" probes one member per round, through
+// SWIM_INDIRECT others when it does not answer, and disseminates suspicions
+bool Config::_set_detector() {
+  auto[detector, detector_ok] = _get_env(FAILURE_DETECTOR);
+  if (detector_ok) {
+    if (detector=="fixed" || detector=="phi" || detector=="swim") {
+      failure_detector_ = detector;
+    } else {
+      spdlog::warn("FAILURE_DETECTOR={} is unknown, using {}", detector, failure_detector_);
+    }
+  }
+  _set_number(PHI_THRESHOLD, std::numeric_limits<double>::min(),
+              std::numeric_limits<double>::max(), phi_threshold_);
+  _set_number(SWIM_INDIRECT, 0, std::numeric_limits<int>::max(), swim_indirect_);
+  return true;
+}
+
 std::tuple<std::string, bool> Config::_get_env(const std::string &t_key) {
   auto ok = false;
   std::string val;
@@ -65,6 +172,26 @@ std::tuple<std::string, bool> Config::_get_env(const std::string &t_key) {
   return std::make_tuple(val, ok);
 }
 
+template<typename T>
+void Config::_set_number(const std::string &t_key, T min, T max, T &out) {
+  auto[val, ok] = _get_env(t_key);
+  if (!ok) {
+    return;
+  }
+  T v{};
+  auto end = val.data() + val.size();
+  auto[ptr, ec] = std::from_chars(val.data(), end, v);
+  if (ec!=std::errc{} || ptr!=end) {
+    spdlog::warn("{}={} is not a number, keeping {}", t_key, val, out);
+    return;
+  }
+  if (v < min || v > max) {
+    spdlog::warn("{}={} is outside [{}, {}], keeping {}", t_key, val, min, max, out);
+    return;
+  }
+  out = v;
+}
+
 std::vector<std::string> Config::split(const std::string &s, char delimiter) {
   std::vector<std::string> tokens;
   std::string token;
@@ -11,6 +11,11 @@ class Config {
   using peers_t = std::vector<std::tuple<std::string, std::string>>;
 
 public:
+  // MTU bounds. The largest UDP payload over IPv4, and room for one peer with an id and
+  // address of 200 bytes each in every wire format, sender id included.
+  static constexpr int MIN_MTU = 1024;
+  static constexpr int MAX_MTU = 65507;
+
   Config();
   ~Config();
   enum class peerz {
@@ -23,18 +28,58 @@ public:
   std::string get_my_id() const;
   std::string get_my_address() const;
   peers_t get_seeds() const;
+  int get_recv_buffer() const;
+  int get_recv_batch() const;
+  int get_listeners() const;
+  std::string get_io_backend() const;
+  int get_full_sync_rounds() const;
+  int get_mtu() const;
+  int get_wire_version() const;
+  std::string get_peer_selection() const;
+  std::string get_failure_detector() const;
+  double get_phi_threshold() const;
+  int get_swim_indirect() const;
 private:
   const std::string MY_ID{"MY_ID"};
   const std::string MY_ADDRESS{ "ADDRESS"};
   const std::string SEEDS{"SEEDS"};
+  const std::string RECV_BUFFER{"RECV_BUFFER"};
+  const std::string RECV_BATCH{"RECV_BATCH"};
+  const std::string LISTENERS{"LISTENERS"};
+  const std::string IO_BACKEND{"IO_BACKEND"};
+  const std::string FULL_SYNC_ROUNDS{"FULL_SYNC_ROUNDS"};
+  const std::string MTU{"MTU"};
+  const std::string WIRE_VERSION{"WIRE_VERSION"};
+  const std::string PEER_SELECTION{"PEER_SELECTION"};
+  const std::string FAILURE_DETECTOR{"FAILURE_DETECTOR"};
+  const std::string PHI_THRESHOLD{"PHI_THRESHOLD"};
+  const std::string SWIM_INDIRECT{"SWIM_INDIRECT"};
 
   std::string my_id_{};
   std::string address_{};
   peers_t seeds_;
+  int recv_buffer_{0};
+  int recv_batch_{64};
+  int listeners_{1};
+  std::string io_backend_{"syscalls"};
+  int full_sync_rounds_{1};
+  int mtu_{2048};
+  int wire_version_{1};
+  std::string peer_selection_{"random"};
+  std::string failure_detector_{"fixed"};
+  double phi_threshold_{8.0};
+  int swim_indirect_{3};
   bool _set_my_id();
   bool _set_address();
   bool _set_seeds();
+  bool _set_receive();
+  bool _set_gossip();
+  bool _set_detector();
 
   std::tuple<std::string, bool> _get_env(const std::string &t_key);
+  // Parses t_key into out when it is set. A value that is not a number or is outside
+  // [min, max] is logged and ignored, out keeps its default.
+  template<typename T>
+  void _set_number(const std::string &t_key, T min, T max, T &out);
 };
 } // namespace gossip
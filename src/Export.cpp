@@ -0,0 +1,118 @@
+#include <algorithm>
+#include "Export.hpp"
+
+namespace gossip {
+
+namespace {
+void sort_by_id(const std::vector<Peer> &peers, std::vector<const Peer *> &out) {
+  out.reserve(peers.size());
+  for (const auto &p : peers) {
+    out.push_back(&p);
+  }
+  std::sort(out.begin(), out.end(), [](const Peer *a, const Peer *b) { return a->get_id() < b->get_id(); });
+}
+
+// Same order as previous when peers holds the peers of its list at the same positions
+bool reorder(const std::vector<Peer> &peers, const std::vector<Peer> &previous_peers,
+             const std::vector<const Peer *> &previous, std::vector<const Peer *> &out) {
+  if (peers.size()!=previous_peers.size()) {
+    return false;
+  }
+  for (std::size_t i = 0; i < peers.size(); ++i) {
+    if (peers[i].get_id()!=previous_peers[i].get_id()) {
+      return false;
+    }
+  }
+  out.reserve(peers.size());
+  for (const auto *p : previous) {
+    out.push_back(&peers[static_cast<std::size_t>(p - previous_peers.data())]);
+  }
+  return true;
+}
+
+bool has_prefix(const std::string &id, std::string_view prefix) {
+  return id.compare(0, prefix.size(), prefix)==0;
+}
+
+using iterator = std::vector<const Peer *>::const_iterator;
+
+// First entry of sorted that may match q
+iterator first(const std::vector<const Peer *> &sorted, const SnapshotIndex::Query &q) {
+  auto less = [](const Peer *p, std::string_view id) { return p->get_id() < id; };
+  if (!q.after.empty() && q.after >= q.prefix) {
+    return std::upper_bound(sorted.begin(), sorted.end(), q.after,
+                            [](std::string_view id, const Peer *p) { return id < p->get_id(); });
+  }
+  return std::lower_bound(sorted.begin(), sorted.end(), q.prefix, less);
+}
+} // namespace
+
+SnapshotIndex::SnapshotIndex(std::shared_ptr<const MembersSnapshot> snapshot, const SnapshotIndex *previous)
+    : snapshot_(std::move(snapshot)) {
+  if (previous==nullptr || !reorder(snapshot_->alive, previous->snapshot_->alive, previous->alive_, alive_)) {
+    sort_by_id(snapshot_->alive, alive_);
+  }
+  if (previous==nullptr
+      || !reorder(snapshot_->suspects, previous->snapshot_->suspects, previous->suspects_, suspects_)) {
+    sort_by_id(snapshot_->suspects, suspects_);
+  }
+}
+
+void SnapshotIndex::page(const Query &q, Page &out) const {
+  out.alive.clear();
+  out.suspects.clear();
+  out.next.clear();
+  auto limit = std::clamp<std::size_t>(q.limit, 1, MAX_LIMIT);
+
+  // Merges both lists in id order, a list ends at its first id past the prefix
+  auto a = q.state==State::suspect ? alive_.end() : first(alive_, q);
+  auto s = q.state==State::alive ? suspects_.end() : first(suspects_, q);
+  auto a_end = alive_.end();
+  auto s_end = suspects_.end();
+  auto matches = [&q](iterator it, iterator end) { return it!=end && has_prefix((*it)->get_id(), q.prefix); };
+
+  const Peer *last = nullptr;
+  std::size_t n = 0;
+  while (n < limit) {
+    auto more_alive = matches(a, a_end);
+    auto more_suspects = matches(s, s_end);
+    if (!more_alive && !more_suspects) {
+      return;
+    }
+    // A peer changing state between the two scans of a snapshot may be in both
+    // lists, it is listed once as alive
+    if (more_alive && (!more_suspects || (*a)->get_id() <= (*s)->get_id())) {
+      if (more_suspects && (*a)->get_id()==(*s)->get_id()) {
+        ++s;
+      }
+      last = *a++;
+      out.alive.push_back(last);
+    } else {
+      last = *s++;
+      out.suspects.push_back(last);
+    }
+    ++n;
+  }
+  if (matches(a, a_end) || matches(s, s_end)) {
+    out.next = last->get_id();
+  }
+}
+
+std::uint64_t SnapshotIndex::version() const {
+  return snapshot_->version;
+}
+
+std::shared_ptr<const SnapshotIndex> IndexCache::get(const Members &members) {
+  auto snapshot = members.snapshot();
+  auto index = std::atomic_load(&index_);
+  if (index!=nullptr && index->version()==snapshot->version) {
+    return index;
+  }
+  auto built = std::make_shared<const SnapshotIndex>(std::move(snapshot), index.get());
+  // A newer index swapped in by a racing caller is kept
+  if (index==nullptr || index->version() < built->version()) {
+    std::atomic_compare_exchange_strong(&index_, &index, built);
+  }
+  return built;
+}
+} // namespace gossip
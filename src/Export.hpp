@@ -0,0 +1,123 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "gossip.hpp"
+
+namespace gossip {
+// Id ordered view of a membership snapshot for paging through big tables. A page is
+// keyed by the last id of the previous one rather than an offset, so a client walking
+// the pages while snapshots are replaced sees every peer that stayed in the table once,
+// in id order, whatever joined or left in between.
+class SnapshotIndex {
+public:
+  static constexpr std::size_t MAX_LIMIT = 10000;
+
+  enum class State {
+    all,
+    alive,
+    suspect
+  };
+  struct Query {
+    State state{State::all};
+    // Only ids starting with prefix
+    std::string_view prefix;
+    // Only ids after this one, the next of the previous page
+    std::string_view after;
+    // Clamped to 1..MAX_LIMIT, /status rejects values out of that range
+    std::size_t limit{1000};
+  };
+  struct Page {
+    std::vector<const Peer *> alive;
+    std::vector<const Peer *> suspects;
+    // Pass as after for the next page, empty on the last one
+    std::string next;
+  };
+
+  // Sorts the snapshot in O(n log n), it is kept alive by the index. With the index
+  // of an earlier snapshot holding the same peers at the same positions, the usual
+  // case when only heartbeats moved, its order is reused in O(n).
+  explicit SnapshotIndex(std::shared_ptr<const MembersSnapshot> snapshot, const SnapshotIndex *previous = nullptr);
+  // Fills out with the next peers matching q in O(log n + limit). Peers stay valid as
+  // long as the index.
+  void page(const Query &q, Page &out) const;
+  std::uint64_t version() const;
+
+private:
+  std::shared_ptr<const MembersSnapshot> snapshot_;
+  std::vector<const Peer *> alive_;
+  std::vector<const Peer *> suspects_;
+};
+
+// Index of the latest published snapshot, built from the previous one by the first
+// caller after a publish and shared by the ones after it. Published with atomic_store,
+// callers never wait on each other, racing first callers may each build it.
+class IndexCache {
+public:
+  std::shared_ptr<const SnapshotIndex> get(const Members &members);
+
+private:
+  std::shared_ptr<const SnapshotIndex> index_;
+};
+
+// Writes a page with any SAX writer of the rapidjson interface, compact with
+// rapidjson::Writer. Same document as the full table plus the version and next cursor.
+template<typename Writer>
+void write_page(Writer &writer, const SnapshotIndex::Page &page, std::uint64_t version) {
+  writer.StartObject();
+  writer.String("version");
+  writer.Uint64(version);
+  writer.String("peers");
+  writer.StartObject();
+  writer.String("alive");
+  writer.StartArray();
+  for (const auto *p : page.alive) {
+    p->Serialize(writer);
+  }
+  writer.EndArray();
+  writer.String("suspects");
+  writer.StartArray();
+  for (const auto *p : page.suspects) {
+    p->Serialize(writer);
+  }
+  writer.EndArray();
+  writer.EndObject();
+  writer.String("next");
+  if (page.next.empty()) {
+    writer.Null();
+  } else {
+    writer.String(page.next.c_str());
+  }
+  writer.EndObject();
+}
+
+// Same page as a msgpack map, peers in the gossip wire format [id, address, heartbeat].
+template<typename Packer>
+void pack_page(Packer &pk, const SnapshotIndex::Page &page, std::uint64_t version) {
+  auto key = [&pk](std::string_view k) {
+    pk.pack_str(static_cast<std::uint32_t>(k.size()));
+    pk.pack_str_body(k.data(), static_cast<std::uint32_t>(k.size()));
+  };
+  pk.pack_map(4);
+  key("version");
+  pk.pack_uint64(version);
+  key("alive");
+  pk.pack_array(static_cast<std::uint32_t>(page.alive.size()));
+  for (const auto *p : page.alive) {
+    pk.pack(*p);
+  }
+  key("suspects");
+  pk.pack_array(static_cast<std::uint32_t>(page.suspects.size()));
+  for (const auto *p : page.suspects) {
+    pk.pack(*p);
+  }
+  key("next");
+  if (page.next.empty()) {
+    pk.pack_nil();
+  } else {
+    key(page.next);
+  }
+}
+} // namespace gossip
@@ -1,6 +1,31 @@
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
 #include "Listener.hpp"
+#include "spdlog/spdlog.h"
+
 namespace gossip {
 
+namespace {
+constexpr std::size_t CONTROL_SIZE = CMSG_SPACE(sizeof(std::uint32_t));
+}
+
+Listener::Listener(std::size_t batch, std::size_t max_size)
+    : max_size_(max_size),
+      ring_(batch*max_size),
+      control_(batch*CONTROL_SIZE),
+      iovs_(batch),
+      msgs_(batch) {
+  for (std::size_t i = 0; i < batch; ++i) {
+    iovs_[i].iov_base = ring_.data() + i*max_size_;
+    iovs_[i].iov_len = max_size_;
+    msgs_[i].msg_hdr.msg_iov = &iovs_[i];
+    msgs_[i].msg_hdr.msg_iovlen = 1;
+    msgs_[i].msg_hdr.msg_control = control_.data() + i*CONTROL_SIZE;
+  }
+}
+
 int Listener::listen_gossip(int sockfd, char *msg, size_t max_size, int cliaddr) {
   int len{0}, n{0};
   n = ::recvfrom(sockfd, msg, max_size,
@@ -9,18 +34,62 @@ int Listener::listen_gossip(int sockfd, char *msg, size_t max_size, int cliaddr)
   return n;
 }
 
+int Listener::receive_batch(int sockfd) {
+  if (msgs_.empty()) {
+    spdlog::error("listener has no receive ring");
+    return -1;
+  }
+  for (auto &m : msgs_) {
+    m.msg_hdr.msg_controllen = CONTROL_SIZE;
+    m.msg_hdr.msg_flags = 0;
+    m.msg_len = 0;
+  }
+
+  auto n = ::recvmmsg(sockfd, msgs_.data(), msgs_.size(), MSG_WAITFORONE, nullptr);
+  if (n < 0) {
+    return -1;
+  }
+  received_.fetch_add(n, std::memory_order_relaxed);
+
+  std::uint64_t bytes = 0;
+  for (int i = 0; i < n; ++i) {
+    bytes += msgs_[i].msg_len;
+    auto &hdr = msgs_[i].msg_hdr;
+    if (hdr.msg_flags & MSG_TRUNC) {
+      truncated_.fetch_add(1, std::memory_order_relaxed);
+    }
+    for (auto c = CMSG_FIRSTHDR(&hdr); c!=nullptr; c = CMSG_NXTHDR(&hdr, c)) {
+      if (c->cmsg_level==SOL_SOCKET && c->cmsg_type==SO_RXQ_OVFL) {
+        std::uint32_t drops;
+        std::memcpy(&drops, CMSG_DATA(c), sizeof(drops));
+        dropped_.store(drops, std::memory_order_relaxed);
+      }
+    }
+  }
+  bytes_received_.fetch_add(bytes, std::memory_order_relaxed);
+  return n;
+}
+
 std::vector<gossip::Peer> Listener::deserialize(const char *sbuf, size_t size) {
+  std::vector<gossip::Peer> rvec;
+  if (wire::is_compact(sbuf, size)) {
+    wire::decode(sbuf, size, [&](std::string_view id, std::string_view address, unsigned int hb, const Trace &trace) {
+      rvec.emplace_back(std::string(id), std::string(address));
+      rvec.back().heartbeat(hb);
+      rvec.back().set_trace(trace);
+    });
+    return rvec;
+  }
   msgpack::object_handle oh =
       msgpack::unpack(sbuf, size);
   msgpack::object obj = oh.get();
 
 // convert object to Peer
-  std::vector<gossip::Peer> rvec;
   obj.convert(rvec);
   return rvec;
 }
 
-int Listener::create_connection(const std::string &addr, const std::string &port) {
+int Listener::create_connection(const std::string &addr, const std::string &port, int rcvbuf, bool reuseport) {
   struct ::sockaddr_in servaddr{}, cliaddr{};
 
   int sockfd;
@@ -37,6 +106,17 @@ int Listener::create_connection(const std::string &addr, const std::string &port
   servaddr.sin_addr.s_addr = inet_addr(addr.c_str());
   servaddr.sin_port = htons(std::stoi(port));
 
+  if (rcvbuf > 0 && setsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf)) < 0) {
+    spdlog::error("cannot set receive buffer size to {}", rcvbuf);
+  }
+  // Report kernel drops with every received datagram
+  int on = 1;
+  setsockopt(sockfd, SOL_SOCKET, SO_RXQ_OVFL, &on, sizeof(on));
+  if (reuseport && setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) < 0) {
+    spdlog::error("cannot set SO_REUSEPORT");
+    exit(EXIT_FAILURE);
+  }
+
   // Bind the socket with the server address
   if (bind(sockfd, (const struct sockaddr *) &servaddr,
            sizeof(servaddr)) < 0) {
@@ -46,4 +126,146 @@ int Listener::create_connection(const std::string &addr, const std::string &port
   return sockfd;
 }
 
-} // namespace gossip
\ No newline at end of file
+bool Listener::use_io_uring(int sockfd) {
+  // At least one ring of recvmmsg batches in flight, each buffer holds one datagram
+  uring_ = uring::Receiver::create(sockfd, std::max<std::size_t>(msgs_.size()*4, 64), max_size_);
+  if (uring_==nullptr) {
+    spdlog::warn("io_uring is not available, receiving with recvmmsg");
+    return false;
+  }
+  return true;
+}
+
+int Listener::poll_fd(int sockfd) const {
+  return uring_!=nullptr ? uring_->fd() : sockfd;
+}
+
+void Listener::wake() {
+  if (uring_!=nullptr) {
+    uring_->wake();
+  }
+}
+
+std::uint64_t Listener::received() const {
+  return received_.load(std::memory_order_relaxed);
+}
+
+std::uint64_t Listener::bytes_received() const {
+  return bytes_received_.load(std::memory_order_relaxed);
+}
+
+std::uint64_t Listener::truncated() const {
+  return truncated_.load(std::memory_order_relaxed) + (uring_!=nullptr ? uring_->truncated() : 0);
+}
+
+std::uint64_t Listener::dropped() const {
+  return uring_!=nullptr ? uring_->dropped() : dropped_.load(std::memory_order_relaxed);
+}
+
+ListenerPool::ListenerPool(std::size_t workers, std::size_t batch, std::size_t max_size) {
+  for (std::size_t i = 0; i < std::max<std::size_t>(workers, 1); ++i) {
+    listeners_.push_back(std::make_unique<Listener>(batch, max_size));
+  }
+}
+
+ListenerPool::~ListenerPool() {
+  stop();
+}
+
+void ListenerPool::bind(const std::string &addr, const std::string &port, int rcvbuf) {
+  is_running.store(true);
+  // Bind every socket before any worker starts so the kernel spreads the load from the first datagram
+  for (std::size_t i = 0; i < listeners_.size(); ++i) {
+    fds_.push_back(listeners_[i]->create_connection(addr, port, rcvbuf, true));
+    if (io_uring_) {
+      listeners_[i]->use_io_uring(fds_[i]);
+    }
+  }
+}
+
+void ListenerPool::use_io_uring() {
+  io_uring_ = true;
+}
+
+void ListenerPool::start(Reactor &reactor, const std::string &addr, const std::string &port, int rcvbuf,
+                         handler_t handler) {
+  bind(addr, port, rcvbuf);
+  for (std::size_t i = 0; i < listeners_.size(); ++i) {
+    reactor.add_reader(listeners_[i]->poll_fd(fds_[i]), [this, i, handler] {
+      listeners_[i]->listen_gossip_batch(fds_[i], handler);
+    });
+  }
+}
+
+void ListenerPool::start(const std::string &addr, const std::string &port, int rcvbuf, handler_t handler) {
+  bind(addr, port, rcvbuf);
+  for (std::size_t i = 0; i < listeners_.size(); ++i) {
+    threads_.emplace_back([this, i, handler] {
+      auto &l = *listeners_[i];
+      while (is_running.load()) {
+        l.listen_gossip_batch(fds_[i], handler);
+      }
+    });
+  }
+}
+
+void ListenerPool::stop() {
+  if (!is_running.exchange(false)) {
+    return;
+  }
+  // Wakes up workers blocked in recvmmsg or io_uring
+  for (auto fd : fds_) {
+    ::shutdown(fd, SHUT_RDWR);
+  }
+  for (auto &l : listeners_) {
+    l->wake();
+  }
+  for (auto &t : threads_) {
+    if (t.joinable()) {
+      t.join();
+    }
+  }
+  for (auto fd : fds_) {
+    ::close(fd);
+  }
+  threads_.clear();
+  fds_.clear();
+}
+
+std::size_t ListenerPool::size() const {
+  return listeners_.size();
+}
+
+std::uint64_t ListenerPool::received() const {
+  std::uint64_t n = 0;
+  for (const auto &l : listeners_) {
+    n += l->received();
+  }
+  return n;
+}
+
+std::uint64_t ListenerPool::bytes_received() const {
+  std::uint64_t n = 0;
+  for (const auto &l : listeners_) {
+    n += l->bytes_received();
+  }
+  return n;
+}
+
+std::uint64_t ListenerPool::truncated() const {
+  std::uint64_t n = 0;
+  for (const auto &l : listeners_) {
+    n += l->truncated();
+  }
+  return n;
+}
+
+std::uint64_t ListenerPool::dropped() const {
+  std::uint64_t n = 0;
+  for (const auto &l : listeners_) {
+    n += l->dropped();
+  }
+  return n;
+}
+
+} // namespace gossip
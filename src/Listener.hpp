@@ -1,13 +1,222 @@
 #pragma once
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
 #include <sstream>
+#include <string_view>
+#include <thread>
+#include <type_traits>
 #include <vector>
 #include "gossip.hpp"
+#include "Reactor.hpp"
+#include "Uring.hpp"
+#include "Wire.hpp"
 
 namespace gossip {
+// Default gossip datagram size, senders split tables to fit and listeners size their
+// ring by it. Every datagram is a complete msgpack array of peers, so chunks of one
+// table decode independently and need no reassembly.
+constexpr std::size_t MAX_DATAGRAM = 2048;
+
 class Listener {
 public:
+  Listener() = default;
+  // batch datagrams of up to max_size bytes are drained per listen_gossip_batch call.
+  Listener(std::size_t batch, std::size_t max_size);
+
   int listen_gossip(int sockfd, char *msg, std::size_t max_size, int cliaddr);
-  std::vector<gossip::Peer> deserialize(const char *sbuf, std::size_t size);
-  int create_connection(const std::string &addr,const std::string &port);
+  // Receives up to batch datagrams with a single recvmmsg into the preallocated ring and
+  // calls fn(const char *, std::size_t) for every complete one. Truncated datagrams are
+  // counted and skipped. Returns the number of datagrams received or -1.
+  template<typename Function>
+  int listen_gossip_batch(int sockfd, Function fn);
+  static std::vector<gossip::Peer> deserialize(const char *sbuf, std::size_t size);
+  // Streams a datagram through msgpack's visitor parser, or the compact decoder of
+  // Wire.hpp when it carries that header, and calls
+  // fn(std::string_view id, std::string_view address, unsigned int heartbeat) per peer,
+  // with a fourth const Trace & when fn takes one, empty unless the datagram is traced.
+  // The views point into sbuf and are only valid during the call. Nothing is allocated.
+  // Throws like deserialize on malformed input, peers before the error were delivered.
+  // Returns the number of peers decoded.
+  template<typename Function>
+  static std::size_t decode(const char *sbuf, std::size_t size, Function fn);
+  // rcvbuf > 0 sets SO_RCVBUF on the bound socket, reuseport allows several sockets
+  // to bind the same port with the kernel balancing datagrams between them.
+  int create_connection(const std::string &addr, const std::string &port, int rcvbuf = 0, bool reuseport = false);
+  // Receives sockfd through a multishot io_uring recvmsg from now on. Returns false and
+  // keeps recvmmsg when built without liburing or the kernel has no support.
+  bool use_io_uring(int sockfd);
+  // Descriptor an event loop waits on before listen_gossip_batch, the ring with io_uring.
+  int poll_fd(int sockfd) const;
+  // Ends a listen_gossip_batch blocked in io_uring, shutting the socket down does not.
+  void wake();
+
+  std::uint64_t received() const;
+  std::uint64_t bytes_received() const;
+  std::uint64_t truncated() const;
+  // Datagrams dropped by the kernel because the socket receive buffer was full.
+  std::uint64_t dropped() const;
+
+private:
+  std::size_t max_size_{MAX_DATAGRAM};
+  std::vector<char> ring_;
+  std::vector<char> control_;
+  std::vector<iovec> iovs_;
+  std::vector<mmsghdr> msgs_;
+
+  std::atomic<std::uint64_t> received_{0};
+  std::atomic<std::uint64_t> bytes_received_{0};
+  std::atomic<std::uint64_t> truncated_{0};
+  std::atomic<std::uint64_t> dropped_{0};
+
+  std::unique_ptr<uring::Receiver> uring_;
+  std::vector<std::pair<const char *, std::size_t>> views_;
+
+  int receive_batch(int sockfd);
+};
+
+template<typename Function>
+int Listener::listen_gossip_batch(int sockfd, Function fn) {
+  if (uring_!=nullptr) {
+    auto n = uring_->receive(views_);
+    if (n > 0) {
+      received_.fetch_add(n, std::memory_order_relaxed);
+    }
+    std::uint64_t bytes = 0;
+    for (const auto &v : views_) {
+      bytes += v.second;
+      fn(v.first, v.second);
+    }
+    bytes_received_.fetch_add(bytes, std::memory_order_relaxed);
+    uring_->release();
+    return n;
+  }
+  auto n = receive_batch(sockfd);
+  for (int i = 0; i < n; ++i) {
+    if (msgs_[i].msg_hdr.msg_flags & MSG_TRUNC) {
+      continue;
+    }
+    fn(static_cast<const char *>(iovs_[i].iov_base), msgs_[i].msg_len);
+  }
+  return n;
+}
+
+namespace detail {
+// Expects [[id, address, heartbeat], ...]. Missing trailing fields are left empty,
+// the same as Peer::msgpack_unpack.
+template<typename Function>
+class PeersVisitor : public msgpack::null_visitor {
+public:
+  explicit PeersVisitor(Function &fn) : fn_(fn) {}
+
+  bool start_array(std::uint32_t) {
+    if (depth_ > 1) throw msgpack::type_error();
+    if (++depth_==2) {
+      item_ = 0;
+      id_ = {};
+      address_ = {};
+      heartbeat_ = 0;
+    }
+    return true;
+  }
+  bool end_array_item() {
+    if (depth_==2) ++item_;
+    return true;
+  }
+  bool end_array() {
+    if (depth_--==2) {
+      if constexpr (std::is_invocable_v<Function &, std::string_view, std::string_view, unsigned int, const Trace &>) {
+        fn_(id_, address_, heartbeat_, Trace{});
+      } else {
+        fn_(id_, address_, heartbeat_);
+      }
+      ++peers_;
+    }
+    return true;
+  }
+  bool visit_str(const char *v, std::uint32_t size) {
+    if (depth_!=2 || item_ > 1) throw msgpack::type_error();
+    (item_==0 ? id_ : address_) = std::string_view(v, size);
+    return true;
+  }
+  bool visit_positive_integer(std::uint64_t v) {
+    if (depth_!=2 || item_!=2 || v > std::numeric_limits<unsigned int>::max()) throw msgpack::type_error();
+    heartbeat_ = static_cast<unsigned int>(v);
+    return true;
+  }
+  bool visit_nil() { throw msgpack::type_error(); }
+  bool visit_boolean(bool) { throw msgpack::type_error(); }
+  bool visit_negative_integer(std::int64_t) { throw msgpack::type_error(); }
+  bool visit_float32(float) { throw msgpack::type_error(); }
+  bool visit_float64(double) { throw msgpack::type_error(); }
+  bool visit_bin(const char *, std::uint32_t) { throw msgpack::type_error(); }
+  bool visit_ext(const char *, std::uint32_t) { throw msgpack::type_error(); }
+  bool start_map(std::uint32_t) { throw msgpack::type_error(); }
+  void parse_error(std::size_t, std::size_t) { throw msgpack::parse_error("parse error"); }
+  void insufficient_bytes(std::size_t, std::size_t) { throw msgpack::insufficient_bytes("insufficient bytes"); }
+
+  std::size_t peers() const { return peers_; }
+
+private:
+  Function &fn_;
+  int depth_{0};
+  std::uint32_t item_{0};
+  std::string_view id_;
+  std::string_view address_;
+  unsigned int heartbeat_{0};
+  std::size_t peers_{0};
+};
+}
+
+template<typename Function>
+std::size_t Listener::decode(const char *sbuf, std::size_t size, Function fn) {
+  if (wire::is_compact(sbuf, size)) {
+    return wire::decode(sbuf, size, fn);
+  }
+  detail::PeersVisitor<Function> visitor{fn};
+  std::size_t off = 0;
+  if (!msgpack::parse(sbuf, size, off, visitor)) {
+    throw msgpack::insufficient_bytes("insufficient bytes");
+  }
+  return visitor.peers();
+}
+
+// N SO_REUSEPORT sockets bound to the same port, each drained by its own thread.
+class ListenerPool {
+public:
+  using handler_t = std::function<void(const char *, std::size_t)>;
+
+  ListenerPool(std::size_t workers, std::size_t batch, std::size_t max_size);
+  ~ListenerPool();
+  ListenerPool(const ListenerPool &) = delete;
+  ListenerPool &operator=(const ListenerPool &) = delete;
+
+  // handler is called concurrently from every worker thread.
+  void start(const std::string &addr, const std::string &port, int rcvbuf, handler_t handler);
+  // Registers the sockets with reactor instead of starting workers, handler is called
+  // from the thread running the reactor, one batch per readable event.
+  void start(Reactor &reactor, const std::string &addr, const std::string &port, int rcvbuf, handler_t handler);
+  // Receives through io_uring when available, set before start.
+  void use_io_uring();
+  // With a reactor, call once it no longer runs.
+  void stop();
+  std::size_t size() const;
+  std::uint64_t received() const;
+  std::uint64_t bytes_received() const;
+  std::uint64_t truncated() const;
+  std::uint64_t dropped() const;
+
+private:
+  std::vector<std::unique_ptr<Listener>> listeners_;
+  std::vector<int> fds_;
+  std::vector<std::thread> threads_;
+  std::atomic<bool> is_running{false};
+  bool io_uring_{false};
+
+  void bind(const std::string &addr, const std::string &port, int rcvbuf);
 };
-} // namespace gossip
\ No newline at end of file
+} // namespace gossip
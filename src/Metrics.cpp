@@ -0,0 +1,116 @@
+#include <algorithm>
+#include <sstream>
+#include "Metrics.hpp"
+
+namespace gossip {
+
+std::uint64_t Counter::value() const {
+  std::uint64_t n = 0;
+  for (const auto &s : slots_) {
+    n += s.value.load(std::memory_order_relaxed);
+  }
+  return n;
+}
+
+std::vector<Histogram::duration> Histogram::default_bounds() {
+  using namespace std::chrono;
+  return {microseconds(50), microseconds(100), microseconds(250), microseconds(500),
+          milliseconds(1), milliseconds(2), milliseconds(5), milliseconds(10),
+          milliseconds(25), milliseconds(50), milliseconds(100), milliseconds(250),
+          milliseconds(500), seconds(1)};
+}
+
+Histogram::Histogram(std::vector<duration> bounds)
+    : unit_(std::chrono::duration<double>(duration(1)).count()), counts_(bounds.size() + 1) {
+  bounds_.reserve(bounds.size());
+  for (auto b : bounds) {
+    bounds_.push_back(static_cast<std::uint64_t>(b.count()));
+  }
+}
+
+Histogram::Histogram(std::vector<std::uint64_t> bounds)
+    : bounds_(std::move(bounds)), unit_(1), counts_(bounds_.size() + 1) {}
+
+void Histogram::observe(duration d) {
+  observe(static_cast<std::uint64_t>(std::max<duration::rep>(d.count(), 0)));
+}
+
+void Histogram::observe(std::uint64_t v) {
+  auto i = std::lower_bound(bounds_.begin(), bounds_.end(), v) - bounds_.begin();
+  counts_[i].fetch_add(1, std::memory_order_relaxed);
+  sum_.fetch_add(v, std::memory_order_relaxed);
+}
+
+std::size_t Histogram::buckets() const {
+  return bounds_.size();
+}
+
+double Histogram::bound(std::size_t i) const {
+  return static_cast<double>(bounds_[i])*unit_;
+}
+
+std::uint64_t Histogram::count(std::size_t i) const {
+  return counts_[i].load(std::memory_order_relaxed);
+}
+
+std::uint64_t Histogram::count() const {
+  std::uint64_t n = 0;
+  for (const auto &c : counts_) {
+    n += c.load(std::memory_order_relaxed);
+  }
+  return n;
+}
+
+double Histogram::sum() const {
+  return static_cast<double>(sum_.load(std::memory_order_relaxed))*unit_;
+}
+
+void Registry::counter(std::string name, std::string help, const Counter &c) {
+  counter(std::move(name), std::move(help), [&c] { return c.value(); });
+}
+
+void Registry::counter(std::string name, std::string help, std::function<std::uint64_t()> read) {
+  std::unique_lock<std::mutex> lock(m_);
+  entries_.push_back(Entry{std::move(name), std::move(help), "counter", std::move(read), nullptr});
+}
+
+void Registry::gauge(std::string name, std::string help, std::function<std::uint64_t()> read) {
+  std::unique_lock<std::mutex> lock(m_);
+  entries_.push_back(Entry{std::move(name), std::move(help), "gauge", std::move(read), nullptr});
+}
+
+void Registry::histogram(std::string name, std::string help, const Histogram &h) {
+  std::unique_lock<std::mutex> lock(m_);
+  entries_.push_back(Entry{std::move(name), std::move(help), "histogram", nullptr, &h});
+}
+
+void Registry::write(std::ostream &os) const {
+  std::unique_lock<std::mutex> lock(m_);
+  for (const auto &e : entries_) {
+    os << "# HELP " << e.name << " " << e.help << "\n"
+       << "# TYPE " << e.name << " " << e.type << "\n";
+    if (e.histogram==nullptr) {
+      os << e.name << " " << e.read() << "\n";
+      continue;
+    }
+    // Buckets are cumulative in the exposition format. count is the +Inf bucket, sum is
+    // read apart and may be off by the observations racing with the scrape
+    const auto &h = *e.histogram;
+    std::uint64_t n = 0;
+    for (std::size_t i = 0; i < h.buckets(); ++i) {
+      n += h.count(i);
+      os << e.name << "_bucket{le=\"" << h.bound(i) << "\"} " << n << "\n";
+    }
+    n += h.count(h.buckets());
+    os << e.name << "_bucket{le=\"+Inf\"} " << n << "\n"
+       << e.name << "_sum " << h.sum() << "\n"
+       << e.name << "_count " << n << "\n";
+  }
+}
+
+std::string Registry::text() const {
+  std::ostringstream os;
+  write(os);
+  return os.str();
+}
+} // namespace gossip
@@ -0,0 +1,117 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace gossip {
+// Monotonic counter added to from any thread. Every thread adds to its own cache line,
+// so listener workers counting the same event never bounce a line between cores,
+// value sums the slots.
+class Counter {
+public:
+  Counter() = default;
+  Counter(const Counter &) = delete;
+  Counter &operator=(const Counter &) = delete;
+
+  void add(std::uint64_t n = 1) {
+    slots_[slot()].value.fetch_add(n, std::memory_order_relaxed);
+  }
+  std::uint64_t value() const;
+
+private:
+  static constexpr std::size_t SLOTS = 16;
+  struct alignas(64) Slot {
+    std::atomic<std::uint64_t> value{0};
+  };
+  std::array<Slot, SLOTS> slots_;
+
+  // Threads are given slots round robin on their first add
+  static std::size_t slot() {
+    static std::atomic<std::size_t> next{0};
+    thread_local std::size_t s = next.fetch_add(1, std::memory_order_relaxed)%SLOTS;
+    return s;
+  }
+};
+
+// Distribution over fixed buckets, bounds are the inclusive upper bounds in increasing
+// order plus an implicit +Inf bucket. Durations are kept in steady_clock ticks and
+// rendered in seconds, plain values such as hop counts as they are. observe is two
+// relaxed adds after a binary search of the bounds.
+class Histogram {
+public:
+  using duration = std::chrono::steady_clock::duration;
+
+  // 50us to 1s, covers a cleanup tick of a small table up to a round of a huge one
+  static std::vector<duration> default_bounds();
+
+  explicit Histogram(std::vector<duration> bounds = default_bounds());
+  explicit Histogram(std::vector<std::uint64_t> bounds);
+  Histogram(const Histogram &) = delete;
+  Histogram &operator=(const Histogram &) = delete;
+
+  void observe(duration d);
+  void observe(std::uint64_t v);
+  // Finite buckets, count(buckets()) is the +Inf one.
+  std::size_t buckets() const;
+  // Upper bound of bucket i in the rendered unit.
+  double bound(std::size_t i) const;
+  // Observations in bucket i alone.
+  std::uint64_t count(std::size_t i) const;
+  std::uint64_t count() const;
+  // Sum of the observations in the rendered unit.
+  double sum() const;
+
+private:
+  std::vector<std::uint64_t> bounds_;
+  double unit_;
+  std::vector<std::atomic<std::uint64_t>> counts_;
+  std::atomic<std::uint64_t> sum_{0};
+};
+
+// Observes the time from construction to destruction.
+class ScopedObserve {
+public:
+  explicit ScopedObserve(Histogram &h) : h_(h), start_(std::chrono::steady_clock::now()) {}
+  ~ScopedObserve() { h_.observe(std::chrono::steady_clock::now() - start_); }
+  ScopedObserve(const ScopedObserve &) = delete;
+  ScopedObserve &operator=(const ScopedObserve &) = delete;
+
+private:
+  Histogram &h_;
+  std::chrono::steady_clock::time_point start_;
+};
+
+// Named metrics rendered in the Prometheus text exposition format. The registry only
+// reads them, they are owned by the components counting them and must outlive it.
+// Register at startup, write may run on any number of threads after that.
+class Registry {
+public:
+  void counter(std::string name, std::string help, const Counter &c);
+  // For counts a component keeps itself, read is called on every write.
+  void counter(std::string name, std::string help, std::function<std::uint64_t()> read);
+  void gauge(std::string name, std::string help, std::function<std::uint64_t()> read);
+  // Duration histograms are rendered in seconds, name should end in _seconds.
+  void histogram(std::string name, std::string help, const Histogram &h);
+
+  void write(std::ostream &os) const;
+  std::string text() const;
+
+private:
+  struct Entry {
+    std::string name;
+    std::string help;
+    const char *type;
+    std::function<std::uint64_t()> read;
+    const Histogram *histogram;
+  };
+
+  mutable std::mutex m_;
+  std::vector<Entry> entries_;
+};
+} // namespace gossip
@@ -0,0 +1,150 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <cerrno>
+#include <cstdint>
+#include <algorithm>
+#include <cstdlib>
+#include "Reactor.hpp"
+#include "spdlog/spdlog.h"
+
+namespace gossip {
+
+namespace {
+constexpr int MAX_EVENTS = 64;
+
+timespec to_timespec(std::chrono::nanoseconds ns) {
+  auto s = std::chrono::duration_cast<std::chrono::seconds>(ns);
+  return timespec{static_cast<time_t>(s.count()), static_cast<long>((ns - s).count())};
+}
+} // namespace
+
+Reactor::Reactor() {
+  epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+  wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (epoll_fd_ < 0 || wake_fd_ < 0) {
+    spdlog::error("cannot create event loop");
+    exit(EXIT_FAILURE);
+  }
+  epoll_event ev{};
+  ev.events = EPOLLIN;
+  ev.data.fd = wake_fd_;
+  epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &ev);
+}
+
+Reactor::~Reactor() {
+  for (const auto &e : entries_) {
+    if (e.second->timer) {
+      ::close(e.first);
+    }
+  }
+  ::close(wake_fd_);
+  ::close(epoll_fd_);
+}
+
+void Reactor::watch(int fd, std::shared_ptr<Entry> entry) {
+  epoll_event ev{};
+  ev.events = EPOLLIN;
+  ev.data.fd = fd;
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) < 0) {
+    spdlog::error("cannot watch descriptor {}", fd);
+    return;
+  }
+  entries_[fd] = std::move(entry);
+}
+
+void Reactor::add_reader(int fd, handler_t on_readable) {
+  auto flags = fcntl(fd, F_GETFL, 0);
+  if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+    spdlog::error("cannot make descriptor {} non-blocking", fd);
+  }
+  watch(fd, std::make_shared<Entry>(Entry{std::move(on_readable), false}));
+}
+
+void Reactor::remove(int fd) {
+  auto it = entries_.find(fd);
+  if (it==entries_.end()) {
+    return;
+  }
+  epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+  if (it->second->timer) {
+    ::close(fd);
+  }
+  entries_.erase(it);
+}
+
+int Reactor::create_timer() {
+  auto fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (fd < 0) {
+    spdlog::error("cannot create timer");
+    exit(EXIT_FAILURE);
+  }
+  return fd;
+}
+
+int Reactor::add_timer(std::chrono::milliseconds interval, handler_t on_tick) {
+  auto fd = create_timer();
+  itimerspec spec{};
+  spec.it_interval = to_timespec(interval);
+  spec.it_value = spec.it_interval;
+  timerfd_settime(fd, 0, &spec, nullptr);
+  watch(fd, std::make_shared<Entry>(Entry{std::move(on_tick), true}));
+  return fd;
+}
+
+int Reactor::add_deadline(handler_t on_expire) {
+  auto fd = create_timer();
+  watch(fd, std::make_shared<Entry>(Entry{std::move(on_expire), true}));
+  return fd;
+}
+
+void Reactor::arm(int timer, clock::time_point when) {
+  // steady_clock is CLOCK_MONOTONIC, a zero value would disarm the timer instead
+  itimerspec spec{};
+  spec.it_value = to_timespec(std::max(when.time_since_epoch(), clock::duration(1)));
+  timerfd_settime(timer, TFD_TIMER_ABSTIME, &spec, nullptr);
+}
+
+void Reactor::run() {
+  epoll_event events[MAX_EVENTS];
+  while (!stopped_.load()) {
+    auto n = epoll_wait(epoll_fd_, events, MAX_EVENTS, -1);
+    if (n < 0) {
+      if (errno==EINTR) {
+        continue;
+      }
+      spdlog::error("event loop failed");
+      return;
+    }
+    for (int i = 0; i < n && !stopped_.load(); ++i) {
+      auto fd = events[i].data.fd;
+      auto it = entries_.find(fd);
+      // Removed by an earlier handler of the same batch
+      if (it==entries_.end()) {
+        continue;
+      }
+      auto entry = it->second;
+      if (entry->timer) {
+        std::uint64_t expirations;
+        if (::read(fd, &expirations, sizeof(expirations))!=sizeof(expirations)) {
+          continue;
+        }
+      }
+      entry->handler();
+    }
+  }
+}
+
+void Reactor::stop() {
+  stopped_.store(true);
+  std::uint64_t one = 1;
+  // Only async-signal-safe calls here, a failed write means the eventfd is already readable
+  [[maybe_unused]] auto n = ::write(wake_fd_, &one, sizeof(one));
+}
+
+bool Reactor::stopped() const {
+  return stopped_.load();
+}
+} // namespace gossip
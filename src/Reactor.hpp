@@ -0,0 +1,57 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+
+namespace gossip {
+// Single threaded epoll loop. Dispatches readable descriptors and timerfd based timers
+// to their handlers from the thread calling run. stop wakes the loop through an
+// eventfd and is safe from any thread or a signal handler, arm is safe from any thread,
+// everything else is called before run or from a handler.
+class Reactor {
+public:
+  using handler_t = std::function<void()>;
+  using clock = std::chrono::steady_clock;
+
+  Reactor();
+  ~Reactor();
+  Reactor(const Reactor &) = delete;
+  Reactor &operator=(const Reactor &) = delete;
+
+  // Calls on_readable whenever fd has data, fd is switched to non-blocking and stays
+  // owned by the caller. The handler should read what it can without looping forever,
+  // the descriptor is level triggered and comes back while data is left.
+  void add_reader(int fd, handler_t on_readable);
+  // Stops watching fd, closes it when it is a timer.
+  void remove(int fd);
+  // Calls on_tick every interval, the first time one interval from now. Ticks missed
+  // while a handler ran are coalesced into one call. Returns the timer id.
+  int add_timer(std::chrono::milliseconds interval, handler_t on_tick);
+  // One shot timer calling on_expire at the time passed to arm. Returns the timer id.
+  int add_deadline(handler_t on_expire);
+  // Arms or re-arms a timer from add_deadline, when in the past it fires right away.
+  void arm(int timer, clock::time_point when);
+
+  // Dispatches until stop. Returns at once when stop was called before.
+  void run();
+  void stop();
+  bool stopped() const;
+
+private:
+  struct Entry {
+    handler_t handler;
+    bool timer{false};
+  };
+
+  int epoll_fd_{-1};
+  int wake_fd_{-1};
+  // Shared so a handler may remove its own descriptor while it runs
+  std::unordered_map<int, std::shared_ptr<Entry>> entries_;
+  std::atomic<bool> stopped_{false};
+
+  void watch(int fd, std::shared_ptr<Entry> entry);
+  int create_timer();
+};
+} // namespace gossip
@@ -0,0 +1,285 @@
+#include <algorithm>
+#include <charconv>
+#include "Listener.hpp"
+#include "Simulator.hpp"
+#include "Wire.hpp"
+
+namespace gossip::sim {
+
+namespace {
+std::string node_id(std::size_t i) {
+  return "node-" + std::to_string(i);
+}
+
+std::string node_address(std::size_t i) {
+  return "10." + std::to_string(i >> 16 & 0xff) + "." + std::to_string(i >> 8 & 0xff) + "."
+      + std::to_string(i & 0xff) + ":5000";
+}
+
+// Index of an id written by node_id, the only ids gossiped in a simulation
+std::size_t node_index(std::string_view id) {
+  std::size_t i = 0;
+  std::from_chars(id.data() + 5, id.data() + id.size(), i);
+  return i;
+}
+
+std::uint64_t micros(std::chrono::microseconds d) {
+  return static_cast<std::uint64_t>(d.count());
+}
+} // namespace
+
+double Report::percentile(const std::vector<double> &sorted, double p) {
+  if (sorted.empty()) {
+    return 0;
+  }
+  return sorted[std::min(sorted.size() - 1, static_cast<std::size_t>(p*sorted.size()))];
+}
+
+Cluster::Cluster(Options options)
+    : options_(options), gen_(options.seed), live_(options.nodes), addresses_(options.nodes) {
+  auto start = std::chrono::steady_clock::now();
+  nodes_.resize(options_.nodes);
+  for (std::size_t i = 0; i < options_.nodes; ++i) {
+    auto &n = nodes_[i];
+    n.members = std::make_unique<Members>();
+    n.members->set_clock([this, start] { return start + std::chrono::microseconds(now_); });
+    n.members->set_trace_clock([this] { return now_; });
+    n.members->set_tround(static_cast<int>(options_.tround.count()));
+    n.members->set_tfail(options_.tfail);
+    n.members->set_tclean(options_.tclean);
+    n.members->set_me(node_id(i));
+    n.delta = DeltaSync{options_.full_sync_rounds};
+
+    auto address = node_address(i);
+    addresses_[i].resize(wire::max_address_size(address));
+    addresses_[i].resize(wire::encode_address(addresses_[i].data(), address));
+  }
+  // Every node knows every other one from the start, only heartbeats travel
+  for (auto &n : nodes_) {
+    for (std::size_t j = 0; j < options_.nodes; ++j) {
+      Peer p{node_id(j), node_address(j)};
+      n.members->add_peer(p);
+    }
+  }
+  known_.assign(options_.nodes*options_.nodes, 1);
+}
+
+void Cluster::crash(std::size_t i, std::chrono::milliseconds at) {
+  nodes_[i].crash_at = micros(at);
+}
+
+Members &Cluster::node(std::size_t i) {
+  return *nodes_[i].members;
+}
+
+void Cluster::schedule(std::uint64_t at, Kind kind, std::size_t node, datagram_t datagram) {
+  events_.push(Event{at, seq_++, kind, node, std::move(datagram)});
+}
+
+Report Cluster::run(std::chrono::milliseconds duration) {
+  auto end = micros(duration);
+  auto rounds = static_cast<std::size_t>(duration/options_.tround) + 2;
+  beat_at_.assign(options_.nodes, std::vector<std::uint64_t>(rounds + 1));
+  reached_.assign(options_.nodes, std::vector<int>(rounds + 1));
+  detected_by_.assign(options_.nodes, 0);
+
+  // Nodes start at random phases of a round and of a tick
+  std::uniform_int_distribution<std::uint64_t> round_phase(0, micros(options_.tround) - 1);
+  std::uniform_int_distribution<std::uint64_t> tick_phase(0, micros(options_.tick) - 1);
+  for (std::size_t i = 0; i < options_.nodes; ++i) {
+    schedule(round_phase(gen_), Kind::round, i);
+    schedule(tick_phase(gen_), Kind::tick, i);
+    if (nodes_[i].crash_at!=never) {
+      schedule(nodes_[i].crash_at, Kind::crash, i);
+    }
+  }
+
+  while (!events_.empty() && events_.top().at <= end) {
+    auto e = events_.top();
+    events_.pop();
+    now_ = e.at;
+    if (nodes_[e.node].crashed) {
+      continue;
+    }
+    switch (e.kind) {
+    case Kind::round:
+      round(e.node);
+      break;
+    case Kind::tick:
+      tick(e.node);
+      break;
+    case Kind::crash:
+      nodes_[e.node].crashed = true;
+      --live_;
+      break;
+    case Kind::deliver:
+      deliver(e.node, *e.datagram);
+      break;
+    }
+  }
+
+  report_.seconds = std::chrono::duration<double>(duration).count();
+  report_.nodes = options_.nodes;
+  double delay = 0, hops = 0, traced = 0;
+  for (const auto &n : nodes_) {
+    const auto &m = n.members->metrics();
+    report_.suspicions += m.suspicions.value();
+    report_.removals += m.removals.value();
+    delay += m.dissemination_delay.sum();
+    hops += m.dissemination_hops.sum();
+    traced += static_cast<double>(m.dissemination_hops.count());
+  }
+  if (traced > 0) {
+    report_.dissemination_delay = delay*1000/traced;
+    report_.dissemination_hops = hops/traced;
+  }
+  auto pairs = static_cast<double>(live_)*static_cast<double>(live_ - 1);
+  report_.false_positive_rate = pairs > 0 ? static_cast<double>(report_.false_suspicions)/pairs : 0;
+  report_.bytes_per_node_per_second = static_cast<double>(report_.bytes)/options_.nodes/report_.seconds;
+  std::sort(report_.convergence.begin(), report_.convergence.end());
+  std::sort(report_.detection.begin(), report_.detection.end());
+  return report_;
+}
+
+void Cluster::round(std::size_t i) {
+  auto &n = nodes_[i];
+  auto &m = *n.members;
+  auto full = n.delta.begin_round(m);
+  m.beat();
+  auto hb = ++known_[i*options_.nodes + i];
+  if (hb < beat_at_[i].size()) {
+    beat_at_[i][hb] = now_;
+    ++report_.increments;
+  }
+
+  // fanout distinct targets, a partial shuffle of the alive handles
+  m.get_alive_handles(handles_);
+  auto k = std::min<std::size_t>(options_.fanout, handles_.size());
+  for (std::size_t t = 0; t < k; ++t) {
+    std::uniform_int_distribution<std::size_t> pick(t, handles_.size() - 1);
+    std::swap(handles_[t], handles_[pick(gen_)]);
+  }
+  if (full) {
+    m.get_alive_peers(table_);
+  } else {
+    n.delta.next(m, table_);
+  }
+  encode(i, table_);
+  for (std::size_t t = 0; t < k; ++t) {
+    auto[peer, alive] = m.find(handles_[t]);
+    if (peer==nullptr) {
+      continue;
+    }
+    send(node_index(peer->get_id()));
+  }
+  schedule(now_ + micros(options_.tround), Kind::round, i);
+}
+
+void Cluster::tick(std::size_t i) {
+  nodes_[i].members->cleanup_task();
+  scan(i);
+  schedule(now_ + micros(options_.tick), Kind::tick, i);
+}
+
+// Split at mtu like Client::serialize of wire version 3
+void Cluster::encode(std::size_t sender, const std::vector<Peer> &peers) {
+  datagrams_.clear();
+  auto id = node_id(sender);
+  msgpack::sbuffer sbuf;
+  std::size_t first = 0;
+  while (first < peers.size()) {
+    sbuf.clear();
+    wire::encode_header(sbuf, id, true);
+    auto header = sbuf.size();
+    for (; first < peers.size(); ++first) {
+      const auto &p = peers[first];
+      scratch_.resize(wire::max_peer_size(p));
+      auto size = wire::encode_peer(scratch_.data(), p, id, addresses_[node_index(p.get_id())], true);
+      if (sbuf.size() + size > options_.mtu) {
+        break;
+      }
+      sbuf.write(scratch_.data(), size);
+    }
+    if (sbuf.size()==header) {
+      ++first;
+      continue;
+    }
+    datagrams_.push_back(std::make_shared<const std::string>(sbuf.data(), sbuf.size()));
+  }
+}
+
+void Cluster::send(std::size_t target) {
+  std::bernoulli_distribution lose(options_.loss);
+  std::uniform_int_distribution<std::uint64_t> jitter(0, micros(options_.jitter));
+  for (const auto &d : datagrams_) {
+    ++report_.datagrams;
+    report_.bytes += d->size();
+    if (lose(gen_)) {
+      ++report_.lost;
+      continue;
+    }
+    schedule(now_ + micros(options_.latency) + jitter(gen_), Kind::deliver, target, d);
+  }
+}
+
+void Cluster::deliver(std::size_t j, const std::string &datagram) {
+  auto &m = *nodes_[j].members;
+  Listener::decode(datagram.data(), datagram.size(),
+                   [&](std::string_view id, std::string_view address, unsigned int hb, const Trace &trace) {
+                     applied(j, node_index(id), hb);
+                     m.heartbeat(id, address, hb, trace);
+                   });
+}
+
+void Cluster::applied(std::size_t j, std::size_t origin, unsigned int heartbeat) {
+  if (origin==j) {
+    return;
+  }
+  auto &known = known_[j*options_.nodes + origin];
+  auto &reached = reached_[origin];
+  for (auto h = known + 1; h <= heartbeat && h < reached.size(); ++h) {
+    if (reached[h] >= 0 && ++reached[h] >= static_cast<int>(live_) - 1) {
+      report_.convergence.push_back(static_cast<double>(now_ - beat_at_[origin][h])/1000);
+      reached[h] = -1;
+    }
+  }
+  known = std::max(known, heartbeat);
+}
+
+// Suspicions are told apart by rescanning the suspects whenever the counters moved
+void Cluster::scan(std::size_t i) {
+  auto &n = nodes_[i];
+  const auto &metrics = n.members->metrics();
+  auto suspicions = metrics.suspicions.value();
+  auto recoveries = metrics.recoveries.value();
+  if (suspicions==n.suspicions_seen && recoveries==n.recoveries_seen) {
+    return;
+  }
+  n.suspicions_seen = suspicions;
+  n.recoveries_seen = recoveries;
+
+  std::vector<std::size_t> suspects;
+  for (const auto &p : n.members->get_suspected_peers()) {
+    auto o = node_index(p.get_id());
+    if (!nodes_[o].crashed) {
+      suspects.push_back(o);
+      continue;
+    }
+    if (std::find(n.detected.begin(), n.detected.end(), o)!=n.detected.end()) {
+      continue;
+    }
+    n.detected.push_back(o);
+    if (detected_by_[o] >= 0 && ++detected_by_[o] >= static_cast<int>(live_)) {
+      report_.detection.push_back(static_cast<double>(now_ - nodes_[o].crash_at)/1000);
+      detected_by_[o] = -1;
+    }
+  }
+  std::sort(suspects.begin(), suspects.end());
+  for (auto o : suspects) {
+    if (!std::binary_search(n.suspects.begin(), n.suspects.end(), o)) {
+      ++report_.false_suspicions;
+    }
+  }
+  n.suspects = std::move(suspects);
+}
+} // namespace gossip::sim
@@ -0,0 +1,147 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <queue>
+#include <random>
+#include <string>
+#include <vector>
+#include "gossip.hpp"
+
+// Deterministic in-process cluster: Members instances on one simulated clock,
+// exchanging traced compact datagrams over a simulated network that loses and delays
+// them. Rounds run as in gspd with the fixed timeout detector, a full table or deltas
+// to fanout random members every tround plus a failure detector tick. Everything
+// random is drawn from one generator seeded by Options::seed, so a seed replays the
+// same run.
+namespace gossip::sim {
+struct Options {
+  std::size_t nodes{1000};
+  unsigned int fanout{3};
+  std::chrono::milliseconds tround{150};
+  // cleanup_task period, bounds how late a deadline fires as the wheel tick does in gspd
+  std::chrono::milliseconds tick{10};
+  unsigned int full_sync_rounds{1};
+  // Suspect after tfail ms without a newer heartbeat, remove tclean ms later
+  int tfail{1000};
+  int tclean{2000};
+  std::size_t mtu{2048};
+  // A datagram is lost with probability loss, else delivered after latency plus a
+  // uniform jitter
+  double loss{0};
+  std::chrono::microseconds latency{500};
+  std::chrono::microseconds jitter{0};
+  std::uint64_t seed{1};
+};
+
+struct Report {
+  double seconds{0};
+  std::size_t nodes{0};
+  // Increments made by the nodes, and in ms sorted, the time for each one that
+  // converged to be applied by every node alive at that time
+  std::uint64_t increments{0};
+  std::vector<double> convergence;
+  // Suspicions of members that were alive, and their rate over the monitored pairs
+  std::uint64_t suspicions{0};
+  std::uint64_t false_suspicions{0};
+  double false_positive_rate{0};
+  // Suspects removed from the tables of every node
+  std::uint64_t removals{0};
+  // In ms sorted, for every crashed node suspected by all nodes alive
+  std::vector<double> detection;
+  std::uint64_t datagrams{0};
+  std::uint64_t lost{0};
+  std::uint64_t bytes{0};
+  double bytes_per_node_per_second{0};
+  // Means over the traced heartbeats applied, from the Members metrics
+  double dissemination_delay{0};
+  double dissemination_hops{0};
+
+  // p in [0, 1] of a sorted sample, 0 when empty
+  static double percentile(const std::vector<double> &sorted, double p);
+};
+
+class Cluster {
+public:
+  explicit Cluster(Options options);
+  Cluster(const Cluster &) = delete;
+  Cluster &operator=(const Cluster &) = delete;
+
+  // Node i stops beating, sending and receiving at, set before run.
+  void crash(std::size_t i, std::chrono::milliseconds at);
+  // Simulates duration from the start, once.
+  Report run(std::chrono::milliseconds duration);
+  Members &node(std::size_t i);
+
+private:
+  static constexpr std::uint64_t never = std::numeric_limits<std::uint64_t>::max();
+  using datagram_t = std::shared_ptr<const std::string>;
+
+  enum class Kind {
+    round,
+    tick,
+    crash,
+    deliver
+  };
+  struct Event {
+    // Simulated microseconds, ties run in the order they were scheduled
+    std::uint64_t at;
+    std::uint64_t seq;
+    Kind kind;
+    std::size_t node;
+    datagram_t datagram;
+  };
+  struct Later {
+    bool operator()(const Event &a, const Event &b) const {
+      return a.at!=b.at ? a.at > b.at : a.seq > b.seq;
+    }
+  };
+  struct Node {
+    std::unique_ptr<Members> members;
+    DeltaSync delta;
+    std::uint64_t crash_at{never};
+    bool crashed{false};
+    // Live nodes it suspected at its last scan, sorted, and the crashed ones it
+    // already suspected
+    std::vector<std::size_t> suspects;
+    std::vector<std::size_t> detected;
+    std::uint64_t suspicions_seen{0};
+    std::uint64_t recoveries_seen{0};
+  };
+
+  Options options_;
+  std::mt19937_64 gen_;
+  std::uint64_t now_{0};
+  std::uint64_t seq_{0};
+  std::size_t live_;
+  std::vector<Node> nodes_;
+  std::priority_queue<Event, std::vector<Event>, Later> events_;
+  // Compact encoded address of every node
+  std::vector<std::string> addresses_;
+
+  // known_[j*nodes + o] is the heartbeat of o applied on j, beat_at_[o][hb] when o
+  // made hb and reached_[o][hb] how many nodes applied it, -1 once converged
+  std::vector<unsigned int> known_;
+  std::vector<std::vector<std::uint64_t>> beat_at_;
+  std::vector<std::vector<int>> reached_;
+  // Nodes that suspected each crashed node, -1 once all did
+  std::vector<int> detected_by_;
+  Report report_;
+
+  // Reused between rounds
+  std::vector<peer_handle> handles_;
+  std::vector<Peer> table_;
+  std::vector<datagram_t> datagrams_;
+  std::string scratch_;
+
+  void schedule(std::uint64_t at, Kind kind, std::size_t node, datagram_t datagram = nullptr);
+  void round(std::size_t i);
+  void tick(std::size_t i);
+  void deliver(std::size_t j, const std::string &datagram);
+  void encode(std::size_t sender, const std::vector<Peer> &peers);
+  void send(std::size_t target);
+  void applied(std::size_t j, std::size_t origin, unsigned int heartbeat);
+  void scan(std::size_t i);
+};
+} // namespace gossip::sim
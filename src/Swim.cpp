@@ -0,0 +1,323 @@
+#include <algorithm>
+#include <cmath>
+#include "Swim.hpp"
+#include "Wire.hpp"
+#include "spdlog/spdlog.h"
+#include "spdlog/fmt/ostr.h"
+
+namespace gossip {
+
+namespace {
+constexpr char MAGIC[] = {'G', 'S'};
+constexpr std::uint8_t VERSION = 1;
+// Longest varint of a 64 bit value
+constexpr std::size_t MAX_VARINT = 10;
+
+std::string_view get_string(const char *&in, const char *end) {
+  auto len = wire::detail::get_varint(in, end);
+  return {wire::detail::take(in, end, len), len};
+}
+} // namespace
+
+Swim::Swim(Members &members, std::string id, std::string address, Options options)
+    : members_(members), id_(std::move(id)), address_(std::move(address)), options_(options) {
+  spread(Update::alive, incarnation_, id_, address_);
+}
+
+Swim::Swim(Members &members, std::string id, std::string address)
+    : Swim(members, std::move(id), std::move(address), Options{}) {}
+
+bool Swim::accepts(const char *buf, std::size_t size) {
+  return size >= 3 && buf[0]==MAGIC[0] && buf[1]==MAGIC[1] && static_cast<std::uint8_t>(buf[2])==VERSION;
+}
+
+void Swim::receive(const char *buf, std::size_t size, clock::time_point now) {
+  if (!accepts(buf, size)) {
+    throw wire::wire_error("not a swim datagram");
+  }
+  const char *in = buf + 3;
+  const char *end = buf + size;
+  auto type = static_cast<Type>(*wire::detail::take(in, end, 1));
+  auto seq = static_cast<std::uint32_t>(wire::detail::get_varint(in, end));
+  char sender_text[wire::ADDRESS_STRLEN];
+  auto sender = get_string(in, end);
+  auto sender_address = wire::detail::get_address(in, end, sender_text);
+  std::string_view target_address;
+  char target_text[wire::ADDRESS_STRLEN];
+  if (type==Type::ping_req) {
+    get_string(in, end);
+    target_address = wire::detail::get_address(in, end, target_text);
+  } else if (type!=Type::ping && type!=Type::ack) {
+    throw wire::wire_error("unknown swim message");
+  }
+
+  std::unique_lock<std::mutex> lock(m_);
+  char text[wire::ADDRESS_STRLEN];
+  while (in < end) {
+    auto kind = static_cast<Update>(*wire::detail::take(in, end, 1));
+    if (kind!=Update::alive && kind!=Update::suspect && kind!=Update::confirm) {
+      throw wire::wire_error("unknown swim update");
+    }
+    auto incarnation = wire::detail::get_varint(in, end);
+    auto id = get_string(in, end);
+    apply(kind, incarnation, id, wire::detail::get_address(in, end, text), now);
+  }
+
+  add(sender, sender_address);
+
+  switch (type) {
+  case Type::ping:
+    send(Type::ack, seq, std::string(sender_address));
+    break;
+  case Type::ping_req: {
+    auto relay = ++seq_;
+    relays_[relay] = Relay{seq, std::string(sender_address), now + options_.period};
+    send(Type::ping, relay, std::string(target_address));
+    break;
+  }
+  case Type::ack:
+    if (probe_ && probe_->seq==seq) {
+      probe_->acked = true;
+    } else if (auto it = relays_.find(seq); it!=relays_.end()) {
+      send(Type::ack, it->second.seq, it->second.requester);
+      relays_.erase(it);
+    }
+    break;
+  }
+}
+
+void Swim::tick(clock::time_point now) {
+  std::unique_lock<std::mutex> lock(m_);
+  if (probe_) {
+    if (probe_->acked) {
+      probe_.reset();
+    } else if (now >= probe_->sent + options_.period) {
+      if (members_.is_alive(probe_->target)) {
+        suspect(probe_->target, incarnations_[probe_->target], probe_->id, probe_->address, now);
+      }
+      probe_.reset();
+    } else if (!probe_->indirect && now >= probe_->sent + options_.ack_timeout) {
+      probe_->indirect = true;
+      members_.get_random_peers(options_.indirect + 1, sample_);
+      unsigned int asked = 0;
+      for (const auto &p : sample_) {
+        if (p.get_handle()==probe_->target || asked==options_.indirect) {
+          continue;
+        }
+        send(Type::ping_req, probe_->seq, p.get_address(), &*probe_);
+        ++asked;
+      }
+      ++indirect_probes_;
+    }
+  }
+
+  for (auto it = suspects_.begin(); it!=suspects_.end();) {
+    if (now < it->second.confirm_at) {
+      ++it;
+      continue;
+    }
+    auto s = std::move(it->second);
+    auto h = it->first;
+    it = suspects_.erase(it);
+    confirm(h, s.id, s.address);
+  }
+  for (auto it = relays_.begin(); it!=relays_.end();) {
+    it = now >= it->second.expires ? relays_.erase(it) : std::next(it);
+  }
+
+  if (!probe_ && now >= next_probe_) {
+    probe(now);
+    next_probe_ = now + options_.period;
+  }
+}
+
+void Swim::probe(clock::time_point now) {
+  targets_.next(members_, 1, sample_);
+  if (sample_.empty()) {
+    return;
+  }
+  const auto &target = sample_.front();
+  probe_ = Probe{++seq_, target.get_handle(), target.get_id(), target.get_address(), now};
+  send(Type::ping, probe_->seq, probe_->address);
+  ++probes_;
+}
+
+void Swim::learn(std::string_view id, std::string_view address) {
+  std::unique_lock<std::mutex> lock(m_);
+  add(id, address);
+}
+
+bool Swim::known(peer_handle h) const {
+  return members_.is_alive(h) || members_.is_dead(h);
+}
+
+void Swim::add(std::string_view id, std::string_view address) {
+  auto h = members_.handle(id);
+  if (id!=id_ && !known(h) && incarnations_.count(h)==0) {
+    members_.heartbeat(id, address, 0);
+  }
+}
+
+void Swim::apply(Update kind, std::uint64_t incarnation, std::string_view id, std::string_view address,
+                 clock::time_point now) {
+  if (id==id_) {
+    // Only we raise our incarnation, which overrides every rumor of our death
+    if (kind!=Update::alive && incarnation >= incarnation_) {
+      incarnation_ = incarnation + 1;
+      spdlog::info("Refute suspicion with incarnation {}", incarnation_);
+      spread(Update::alive, incarnation_, id_, address_);
+    }
+    return;
+  }
+
+  auto h = members_.handle(id);
+  auto it = h==no_handle ? incarnations_.end() : incarnations_.find(h);
+  auto heard = it!=incarnations_.end();
+  switch (kind) {
+  case Update::alive:
+    if (heard && incarnation <= it->second) {
+      return;
+    }
+    if (!known(h)) {
+      members_.heartbeat(id, address, 0);
+      h = members_.handle(id);
+    } else if (members_.is_dead(h)) {
+      members_.refute(h);
+      suspects_.erase(h);
+    }
+    incarnations_[h] = incarnation;
+    spread(kind, incarnation, id, address);
+    break;
+  case Update::suspect:
+    if (!known(h) || (heard && incarnation < it->second)) {
+      return;
+    }
+    if (members_.is_alive(h)) {
+      suspect(h, incarnation, id, address, now);
+    } else if (!heard || incarnation > it->second) {
+      incarnations_[h] = incarnation;
+      spread(kind, incarnation, id, address);
+    }
+    break;
+  case Update::confirm:
+    if (h==no_handle) {
+      return;
+    }
+    incarnations_[h] = std::max(incarnation, heard ? it->second : 0);
+    if (known(h)) {
+      suspects_.erase(h);
+      confirm(h, id, address);
+    }
+    break;
+  }
+}
+
+void Swim::suspect(peer_handle h, std::uint64_t incarnation, std::string_view id, std::string_view address,
+                   clock::time_point now) {
+  incarnations_[h] = incarnation;
+  members_.deadline(h);
+  suspects_.try_emplace(h, Suspicion{now + options_.suspicion, std::string(id), std::string(address)});
+  ++suspicions_;
+  spread(Update::suspect, incarnation, id, address);
+}
+
+void Swim::confirm(peer_handle h, std::string_view id, std::string_view address) {
+  members_.deadline(h);
+  members_.cleanup(h);
+  spread(Update::confirm, incarnations_[h], id, address);
+}
+
+void Swim::spread(Update kind, std::uint64_t incarnation, std::string_view id, std::string_view address) {
+  auto it = std::find_if(rumors_.begin(), rumors_.end(), [&](const Rumor &r) { return r.id==id; });
+  if (it==rumors_.end()) {
+    rumors_.push_back(Rumor{kind, incarnation, std::string(id), std::string(address)});
+    return;
+  }
+  it->kind = kind;
+  it->incarnation = incarnation;
+  it->address = address;
+  it->transmits = 0;
+}
+
+void Swim::put_member(std::string_view id, std::string_view address) {
+  scratch_.resize(MAX_VARINT + id.size() + wire::max_address_size(address));
+  auto out = wire::put_varint(scratch_.data(), id.size());
+  std::memcpy(out, id.data(), id.size());
+  out += id.size();
+  out += wire::encode_address(out, address);
+  sbuf_.write(scratch_.data(), out - scratch_.data());
+}
+
+void Swim::piggyback() {
+  if (rumors_.empty()) {
+    return;
+  }
+  // Fresh rumors first, each one goes out a number of times logarithmic in the
+  // cluster size, which is enough for it to reach everybody with high probability
+  std::stable_sort(rumors_.begin(), rumors_.end(),
+                   [](const Rumor &a, const Rumor &b) { return a.transmits < b.transmits; });
+  auto limit = static_cast<unsigned int>(
+      options_.retransmit_mult*std::ceil(std::log2(static_cast<double>(members_.size()) + 1)));
+  limit = std::max(limit, 1u);
+  for (auto &r : rumors_) {
+    scratch_.resize(1 + 2*MAX_VARINT + r.id.size() + wire::max_address_size(r.address));
+    auto out = scratch_.data();
+    *out++ = static_cast<char>(r.kind);
+    out = wire::put_varint(out, r.incarnation);
+    out = wire::put_varint(out, r.id.size());
+    std::memcpy(out, r.id.data(), r.id.size());
+    out += r.id.size();
+    out += wire::encode_address(out, r.address);
+    auto n = static_cast<std::size_t>(out - scratch_.data());
+    if (sbuf_.size() + n > options_.max_size) {
+      break;
+    }
+    sbuf_.write(scratch_.data(), n);
+    ++r.transmits;
+  }
+  rumors_.erase(std::remove_if(rumors_.begin(), rumors_.end(),
+                               [limit](const Rumor &r) { return r.transmits >= limit; }),
+                rumors_.end());
+}
+
+void Swim::send(Type type, std::uint32_t seq, const std::string &to, const Probe *target) {
+  sbuf_.clear();
+  char header[4 + MAX_VARINT];
+  header[0] = MAGIC[0];
+  header[1] = MAGIC[1];
+  header[2] = static_cast<char>(VERSION);
+  header[3] = static_cast<char>(type);
+  auto end = wire::put_varint(header + 4, seq);
+  sbuf_.write(header, end - header);
+  put_member(id_, address_);
+  if (target!=nullptr) {
+    put_member(target->id, target->address);
+  }
+  piggyback();
+  client_.send_to(sbuf_.data(), sbuf_.size(), to);
+}
+
+std::uint64_t Swim::incarnation() const {
+  std::unique_lock<std::mutex> lock(m_);
+  return incarnation_;
+}
+
+std::uint64_t Swim::probes() const {
+  std::unique_lock<std::mutex> lock(m_);
+  return probes_;
+}
+
+std::uint64_t Swim::indirect_probes() const {
+  std::unique_lock<std::mutex> lock(m_);
+  return indirect_probes_;
+}
+
+std::uint64_t Swim::suspicions() const {
+  std::unique_lock<std::mutex> lock(m_);
+  return suspicions_;
+}
+
+std::uint64_t Swim::bytes_sent() const {
+  return client_.bytes_sent();
+}
+} // namespace gossip
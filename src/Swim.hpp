@@ -0,0 +1,144 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <msgpack.hpp>
+#include "gossip.hpp"
+#include "Client.hpp"
+
+// SWIM failure detection and membership dissemination.
+//
+//   'G' 'S' version  type  varint(seq)  sender  [target]  update*
+//
+// sender and target are varint(len) id followed by an address as written by
+// wire::encode_address, target is only present in a ping-req. Every message carries
+// as many updates as fit, each one kind byte, varint(incarnation), varint(len) id and
+// an address. A ping is answered with an ack of the same seq. A ping-req asks the
+// receiver to ping target and forward the ack to the sender.
+namespace gossip {
+class Swim {
+public:
+  using clock = std::chrono::steady_clock;
+
+  struct Options {
+    // Members asked to probe a target that missed its direct ack
+    unsigned int indirect{3};
+    // One probe per period, a target is suspected when no ack came back by its end
+    std::chrono::milliseconds period{150};
+    // Wait for a direct ack before falling back to indirect probes
+    std::chrono::milliseconds ack_timeout{50};
+    // Time a suspect has to refute before it is confirmed dead and removed
+    std::chrono::milliseconds suspicion{750};
+    // Every update is piggybacked mult*log2(n + 1) times
+    unsigned int retransmit_mult{3};
+    std::size_t max_size{1400};
+  };
+
+  // Probes the alive peers of members on behalf of the node id listening at address.
+  // Sends from its own socket so listener threads can answer while the sender thread probes.
+  Swim(Members &members, std::string id, std::string address, Options options);
+  Swim(Members &members, std::string id, std::string address);
+  Swim(const Swim &) = delete;
+  Swim &operator=(const Swim &) = delete;
+
+  static bool accepts(const char *buf, std::size_t size);
+  // Handles one datagram accepted by accepts. Throws wire::wire_error on malformed input.
+  void receive(const char *buf, std::size_t size, clock::time_point now);
+  // Starts a probe every period and moves the current one, suspicions and forwarded
+  // probes along. Call at least every ack_timeout/2 or so.
+  void tick(clock::time_point now);
+  // Adds a member heard of outside of SWIM, from a gossiped table, unless it was
+  // confirmed dead and has not announced a newer incarnation since.
+  void learn(std::string_view id, std::string_view address);
+
+  std::uint64_t incarnation() const;
+  std::uint64_t probes() const;
+  std::uint64_t indirect_probes() const;
+  std::uint64_t suspicions() const;
+  std::uint64_t bytes_sent() const;
+
+private:
+  enum class Type : std::uint8_t {
+    ping = 1,
+    ack = 2,
+    ping_req = 3
+  };
+  enum class Update : std::uint8_t {
+    alive = 1,
+    suspect = 2,
+    confirm = 3
+  };
+  struct Rumor {
+    Update kind;
+    std::uint64_t incarnation;
+    std::string id;
+    std::string address;
+    unsigned int transmits{0};
+  };
+  struct Probe {
+    std::uint32_t seq;
+    peer_handle target;
+    std::string id;
+    std::string address;
+    clock::time_point sent;
+    bool indirect{false};
+    bool acked{false};
+  };
+  // A ping sent on behalf of a ping-req, its ack goes back to requester as seq
+  struct Relay {
+    std::uint32_t seq;
+    std::string requester;
+    clock::time_point expires;
+  };
+  struct Suspicion {
+    clock::time_point confirm_at;
+    std::string id;
+    std::string address;
+  };
+
+  Members &members_;
+  std::string id_;
+  std::string address_;
+  Options options_;
+  Client client_;
+
+  mutable std::mutex m_;
+  std::uint64_t incarnation_{0};
+  std::uint32_t seq_{0};
+  clock::time_point next_probe_{};
+  std::optional<Probe> probe_;
+  std::unordered_map<std::uint32_t, Relay> relays_;
+  // Last incarnation heard of per peer handle
+  std::unordered_map<peer_handle, std::uint64_t> incarnations_;
+  // Suspects are confirmed dead at confirm_at unless they refute first
+  std::unordered_map<peer_handle, Suspicion> suspects_;
+  std::vector<Rumor> rumors_;
+  // Probe targets in shuffled round-robin order, bounding the time to first probe a failed member
+  RoundRobin targets_;
+  std::vector<Peer> sample_;
+  msgpack::sbuffer sbuf_;
+  std::vector<char> scratch_;
+
+  std::uint64_t probes_{0};
+  std::uint64_t indirect_probes_{0};
+  std::uint64_t suspicions_{0};
+
+  void send(Type type, std::uint32_t seq, const std::string &to, const Probe *target = nullptr);
+  void put_member(std::string_view id, std::string_view address);
+  void piggyback();
+  void spread(Update kind, std::uint64_t incarnation, std::string_view id, std::string_view address);
+  void apply(Update kind, std::uint64_t incarnation, std::string_view id, std::string_view address,
+             clock::time_point now);
+  bool known(peer_handle h) const;
+  void add(std::string_view id, std::string_view address);
+  void suspect(peer_handle h, std::uint64_t incarnation, std::string_view id, std::string_view address,
+               clock::time_point now);
+  void confirm(peer_handle h, std::string_view id, std::string_view address);
+  void probe(clock::time_point now);
+};
+} // namespace gossip
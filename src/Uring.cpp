@@ -0,0 +1,311 @@
+#include "Uring.hpp"
+
+#ifdef GSPD_IO_URING
+#include <liburing.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include "spdlog/spdlog.h"
+#endif
+
+namespace gossip::uring {
+
+#ifdef GSPD_IO_URING
+namespace {
+constexpr int BUFFER_GROUP = 0;
+// user_data of the completions, telling datagrams from a wake up
+constexpr std::uint64_t RECEIVE = 0;
+constexpr std::uint64_t WAKE = 1;
+constexpr std::size_t CONTROL_SIZE = CMSG_SPACE(sizeof(std::uint32_t));
+
+std::size_t round_pow2(std::size_t n) {
+  std::size_t p = 1;
+  while (p < n) {
+    p <<= 1;
+  }
+  return p;
+}
+
+class RingReceiver : public Receiver {
+public:
+  RingReceiver(int sockfd, std::size_t buffers, std::size_t max_size)
+      : sockfd_(sockfd),
+        buffers_(static_cast<unsigned int>(round_pow2(buffers))),
+        // Every buffer starts with the recvmsg header and control data the kernel writes
+        buffer_size_(sizeof(io_uring_recvmsg_out) + CONTROL_SIZE + max_size),
+        memory_(buffers_*buffer_size_) {}
+
+  ~RingReceiver() override {
+    if (ring_ok_) {
+      if (buf_ring_!=nullptr) {
+        io_uring_free_buf_ring(&ring_, buf_ring_, buffers_, BUFFER_GROUP);
+      }
+      io_uring_queue_exit(&ring_);
+    }
+    if (wake_fd_ >= 0) {
+      ::close(wake_fd_);
+    }
+  }
+
+  bool init() {
+    wake_fd_ = ::eventfd(0, EFD_CLOEXEC);
+    if (wake_fd_ < 0) {
+      spdlog::error("cannot create eventfd: {}", std::strerror(errno));
+      return false;
+    }
+    io_uring_params params{};
+    auto ret = io_uring_queue_init_params(64, &ring_, &params);
+    if (ret < 0) {
+      spdlog::error("cannot create io_uring: {}", std::strerror(-ret));
+      return false;
+    }
+    ring_ok_ = true;
+    buf_ring_ = io_uring_setup_buf_ring(&ring_, buffers_, BUFFER_GROUP, 0, &ret);
+    if (buf_ring_==nullptr) {
+      spdlog::error("cannot register io_uring buffers: {}", std::strerror(-ret));
+      return false;
+    }
+    for (unsigned int i = 0; i < buffers_; ++i) {
+      io_uring_buf_ring_add(buf_ring_, memory_.data() + i*buffer_size_, buffer_size_, i,
+                            io_uring_buf_ring_mask(buffers_), i);
+    }
+    io_uring_buf_ring_advance(buf_ring_, buffers_);
+
+    // The source address is not needed, only the drop counter comes as control data
+    msg_.msg_namelen = 0;
+    msg_.msg_controllen = CONTROL_SIZE;
+
+    // A read of the eventfd stays posted next to the receive so wake can end a wait
+    auto sqe = io_uring_get_sqe(&ring_);
+    io_uring_prep_read(sqe, wake_fd_, &wake_value_, sizeof(wake_value_), 0);
+    io_uring_sqe_set_data64(sqe, WAKE);
+    return post();
+  }
+
+  int receive(std::vector<std::pair<const char *, std::size_t>> &out) override {
+    out.clear();
+    if (closed_) {
+      return -1;
+    }
+    io_uring_cqe *cqe;
+    auto ret = io_uring_wait_cqe(&ring_, &cqe);
+    if (ret < 0) {
+      return ret==-EINTR ? 0 : -1;
+    }
+
+    unsigned int head;
+    unsigned int seen = 0;
+    int received = 0;
+    bool repost = false;
+    io_uring_for_each_cqe(&ring_, head, cqe) {
+      ++seen;
+      if (io_uring_cqe_get_data64(cqe)==WAKE) {
+        closed_ = true;
+        continue;
+      }
+      if (!(cqe->flags & IORING_CQE_F_MORE)) {
+        repost = true;
+      }
+      if (cqe->res < 0) {
+        // Out of buffers ends the multishot until some are handed back, anything else
+        // means the socket is gone
+        if (cqe->res!=-ENOBUFS) {
+          closed_ = true;
+        }
+        continue;
+      }
+      if (!(cqe->flags & IORING_CQE_F_BUFFER)) {
+        continue;
+      }
+      auto id = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+      auto buf = memory_.data() + id*buffer_size_;
+      held_.push_back(id);
+      auto msg = io_uring_recvmsg_validate(buf, cqe->res, &msg_);
+      if (msg==nullptr) {
+        continue;
+      }
+      ++received;
+      for (auto c = io_uring_recvmsg_cmsg_firsthdr(msg, &msg_); c!=nullptr;
+           c = io_uring_recvmsg_cmsg_nexthdr(msg, &msg_, c)) {
+        if (c->cmsg_level==SOL_SOCKET && c->cmsg_type==SO_RXQ_OVFL) {
+          std::uint32_t drops;
+          std::memcpy(&drops, CMSG_DATA(c), sizeof(drops));
+          dropped_.store(drops, std::memory_order_relaxed);
+        }
+      }
+      if (msg->flags & MSG_TRUNC) {
+        truncated_.fetch_add(1, std::memory_order_relaxed);
+        continue;
+      }
+      out.emplace_back(static_cast<const char *>(io_uring_recvmsg_payload(msg, &msg_)),
+                       io_uring_recvmsg_payload_length(msg, cqe->res, &msg_));
+    }
+    io_uring_cq_advance(&ring_, seen);
+    if (closed_) {
+      return -1;
+    }
+    if (repost) {
+      repost_ = true;
+    }
+    return received;
+  }
+
+  void release() override {
+    for (auto id : held_) {
+      io_uring_buf_ring_add(buf_ring_, memory_.data() + id*buffer_size_, buffer_size_, id,
+                            io_uring_buf_ring_mask(buffers_), 0);
+    }
+    io_uring_buf_ring_advance(buf_ring_, static_cast<int>(held_.size()));
+    held_.clear();
+    // Re-posted once buffers are back, else it would stop again on ENOBUFS
+    if (repost_) {
+      repost_ = false;
+      post();
+    }
+  }
+
+  void wake() override {
+    std::uint64_t one = 1;
+    if (::write(wake_fd_, &one, sizeof(one)) < 0) {
+      spdlog::warn("cannot wake io_uring receiver: {}", std::strerror(errno));
+    }
+  }
+
+  int fd() const override {
+    return ring_.ring_fd;
+  }
+
+  std::uint64_t truncated() const override {
+    return truncated_.load(std::memory_order_relaxed);
+  }
+
+  std::uint64_t dropped() const override {
+    return dropped_.load(std::memory_order_relaxed);
+  }
+
+private:
+  int sockfd_;
+  unsigned int buffers_;
+  std::size_t buffer_size_;
+  std::vector<char> memory_;
+  io_uring ring_{};
+  bool ring_ok_{false};
+  io_uring_buf_ring *buf_ring_{nullptr};
+  msghdr msg_{};
+  int wake_fd_{-1};
+  std::uint64_t wake_value_{0};
+  std::vector<unsigned short> held_;
+  bool repost_{false};
+  bool closed_{false};
+  std::atomic<std::uint64_t> truncated_{0};
+  std::atomic<std::uint64_t> dropped_{0};
+
+  bool post() {
+    auto sqe = io_uring_get_sqe(&ring_);
+    if (sqe==nullptr) {
+      return false;
+    }
+    io_uring_prep_recvmsg_multishot(sqe, sockfd_, &msg_, 0);
+    io_uring_sqe_set_data64(sqe, RECEIVE);
+    sqe->flags |= IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BUFFER_GROUP;
+    return io_uring_submit(&ring_) >= 0;
+  }
+};
+
+class RingSender : public Sender {
+public:
+  RingSender(int sockfd, std::size_t entries) : sockfd_(sockfd), entries_(static_cast<unsigned int>(entries)) {}
+
+  ~RingSender() override {
+    if (ring_ok_) {
+      io_uring_queue_exit(&ring_);
+    }
+  }
+
+  bool init() {
+    auto ret = io_uring_queue_init(entries_, &ring_, 0);
+    if (ret < 0) {
+      spdlog::error("cannot create io_uring: {}", std::strerror(-ret));
+      return false;
+    }
+    ring_ok_ = true;
+    return true;
+  }
+
+  int send(std::vector<mmsghdr> &msgs) override {
+    int sent = 0;
+    std::size_t next = 0;
+    while (next < msgs.size()) {
+      // As many sendmsg as the submission queue holds, then one enter that waits for all
+      unsigned int queued = 0;
+      while (next < msgs.size()) {
+        auto sqe = io_uring_get_sqe(&ring_);
+        if (sqe==nullptr) {
+          break;
+        }
+        io_uring_prep_sendmsg(sqe, sockfd_, &msgs[next].msg_hdr, 0);
+        ++next;
+        ++queued;
+      }
+      auto ret = io_uring_submit_and_wait(&ring_, queued);
+      if (ret < 0) {
+        return sent > 0 ? sent : -2;
+      }
+      for (unsigned int i = 0; i < queued; ++i) {
+        io_uring_cqe *cqe;
+        if (io_uring_wait_cqe(&ring_, &cqe) < 0) {
+          return sent > 0 ? sent : -2;
+        }
+        if (cqe->res >= 0) {
+          ++sent;
+        }
+        io_uring_cqe_seen(&ring_, cqe);
+      }
+    }
+    return sent;
+  }
+
+private:
+  int sockfd_;
+  unsigned int entries_;
+  io_uring ring_{};
+  bool ring_ok_{false};
+};
+} // namespace
+
+std::unique_ptr<Receiver> Receiver::create(int sockfd, std::size_t buffers, std::size_t max_size) {
+  auto r = std::make_unique<RingReceiver>(sockfd, buffers, max_size);
+  if (!r->init()) {
+    return nullptr;
+  }
+  return r;
+}
+
+std::unique_ptr<Sender> Sender::create(int sockfd, std::size_t entries) {
+  auto s = std::make_unique<RingSender>(sockfd, entries);
+  if (!s->init()) {
+    return nullptr;
+  }
+  return s;
+}
+
+bool available() {
+  return true;
+}
+#else
+std::unique_ptr<Receiver> Receiver::create(int, std::size_t, std::size_t) {
+  return nullptr;
+}
+
+std::unique_ptr<Sender> Sender::create(int, std::size_t) {
+  return nullptr;
+}
+
+bool available() {
+  return false;
+}
+#endif
+} // namespace gossip::uring
@@ -0,0 +1,48 @@
+#pragma once
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+// Optional io_uring I/O for the gossip UDP sockets, built when CMake finds liburing
+// (GSPD_IO_URING). Without it, or when the kernel refuses a ring, create returns
+// nullptr and callers keep the recvmmsg/sendmmsg path.
+namespace gossip::uring {
+// Keeps one multishot recvmsg posted on a socket against a ring of provided buffers,
+// so receiving costs one io_uring_enter per batch of completions and none per datagram.
+class Receiver {
+public:
+  // buffers is rounded up to a power of two, each holds one datagram of max_size bytes.
+  static std::unique_ptr<Receiver> create(int sockfd, std::size_t buffers, std::size_t max_size);
+  virtual ~Receiver() = default;
+
+  // Waits for at least one completion and writes the complete datagrams over out, they
+  // stay valid until release. Returns the number of datagrams received, truncated
+  // ones included, or -1 when the socket was shut down.
+  virtual int receive(std::vector<std::pair<const char *, std::size_t>> &out) = 0;
+  // Hands the buffers of the last receive back to the kernel.
+  virtual void release() = 0;
+  // Makes a receive waiting in another thread return -1, the receiver is done after it.
+  virtual void wake() = 0;
+  // Readable when completions are waiting, for an event loop.
+  virtual int fd() const = 0;
+  virtual std::uint64_t truncated() const = 0;
+  virtual std::uint64_t dropped() const = 0;
+};
+
+// Queues one sendmsg per target and submits them with a single io_uring_enter.
+class Sender {
+public:
+  static std::unique_ptr<Sender> create(int sockfd, std::size_t entries);
+  virtual ~Sender() = default;
+
+  // Sends every message, which must stay valid until the call returns. Returns the
+  // number of datagrams the kernel accepted or a negative error.
+  virtual int send(std::vector<mmsghdr> &msgs) = 0;
+};
+
+// True when built with liburing.
+bool available();
+} // namespace gossip::uring
@@ -0,0 +1,129 @@
+#include <algorithm>
+#include "Wire.hpp"
+
+namespace gossip::wire {
+
+namespace {
+// Longest varint of a 64 bit value
+constexpr std::size_t MAX_VARINT = 10;
+
+struct Address {
+  std::uint8_t family{ADDRESS_TEXT};
+  char addr[16];
+  std::uint16_t port{0};
+};
+
+// Binary form of a canonical "ip:port" or "[ip6]:port". Anything that would not
+// decode back to the same text, hostnames or leading zeros, stays text.
+Address parse_address(std::string_view address) {
+  Address a;
+  auto sep = address.rfind(':');
+  if (sep==std::string_view::npos || sep + 1==address.size()) {
+    return a;
+  }
+  auto host = address.substr(0, sep);
+  auto port = address.substr(sep + 1);
+  int family = AF_INET;
+  if (host.size() > 2 && host.front()=='[' && host.back()==']') {
+    host = host.substr(1, host.size() - 2);
+    family = AF_INET6;
+  }
+  char h[INET6_ADDRSTRLEN];
+  if (host.size() >= sizeof(h)) {
+    return a;
+  }
+  std::memcpy(h, host.data(), host.size());
+  h[host.size()] = '\0';
+  unsigned int p = 0;
+  auto[end, ec] = std::from_chars(port.data(), port.data() + port.size(), p);
+  if (ec!=std::errc() || end!=port.data() + port.size() || p > 65535 || inet_pton(family, h, a.addr)!=1) {
+    return a;
+  }
+
+  char text[ADDRESS_STRLEN];
+  if (detail::format_address(family, a.addr, static_cast<std::uint16_t>(p), text)!=address) {
+    return a;
+  }
+  a.family = family==AF_INET ? ADDRESS_V4 : ADDRESS_V6;
+  a.port = static_cast<std::uint16_t>(p);
+  return a;
+}
+} // namespace
+
+bool is_compact(const char *buf, std::size_t size) {
+  if (size < 3 || buf[0]!=MAGIC[0] || buf[1]!=MAGIC[1]) {
+    return false;
+  }
+  auto version = static_cast<std::uint8_t>(buf[2]);
+  return version==VERSION || version==VERSION_TRACED;
+}
+
+char *put_varint(char *out, std::uint64_t v) {
+  while (v >= 0x80) {
+    *out++ = static_cast<char>((v & 0x7f) | 0x80);
+    v >>= 7;
+  }
+  *out++ = static_cast<char>(v);
+  return out;
+}
+
+void encode_header(msgpack::sbuffer &sbuf, std::string_view sender, bool traced) {
+  char header[3 + MAX_VARINT];
+  header[0] = MAGIC[0];
+  header[1] = MAGIC[1];
+  header[2] = static_cast<char>(traced ? VERSION_TRACED : VERSION);
+  auto end = put_varint(header + 3, sender.size());
+  sbuf.write(header, end - header);
+  sbuf.write(sender.data(), sender.size());
+}
+
+std::size_t max_address_size(std::string_view address) {
+  // family and the larger of text and binary IPv6 address
+  return 1 + std::max<std::size_t>(MAX_VARINT + address.size(), 16 + 2);
+}
+
+std::size_t encode_address(char *out, std::string_view address) {
+  auto start = out;
+  auto a = parse_address(address);
+  *out++ = static_cast<char>(a.family);
+  if (a.family==ADDRESS_TEXT) {
+    out = put_varint(out, address.size());
+    std::memcpy(out, address.data(), address.size());
+    out += address.size();
+  } else {
+    auto len = a.family==ADDRESS_V4 ? 4 : 16;
+    std::memcpy(out, a.addr, len);
+    out += len;
+    *out++ = static_cast<char>(a.port >> 8);
+    *out++ = static_cast<char>(a.port & 0xff);
+  }
+  return out - start;
+}
+
+std::size_t max_peer_size(const Peer &p) {
+  // tag, id, heartbeat, address and trace
+  return MAX_VARINT + p.get_id().size() + MAX_VARINT + max_address_size(p.get_address()) + 2*MAX_VARINT;
+}
+
+std::size_t encode_peer(char *out, const Peer &p, std::string_view sender, std::string_view address,
+                        bool traced) {
+  auto start = out;
+  const auto &id = p.get_id();
+  if (!sender.empty() && id==sender) {
+    out = put_varint(out, 1);
+  } else {
+    out = put_varint(out, static_cast<std::uint64_t>(id.size()) << 1);
+    std::memcpy(out, id.data(), id.size());
+    out += id.size();
+  }
+  out = put_varint(out, p.get_heartbeat());
+  std::memcpy(out, address.data(), address.size());
+  out += address.size();
+  if (traced) {
+    auto trace = p.get_trace();
+    out = put_varint(out, trace.origin);
+    out = put_varint(out, trace.hops);
+  }
+  return out - start;
+}
+} // namespace gossip::wire
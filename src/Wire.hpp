@@ -0,0 +1,161 @@
+#pragma once
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string_view>
+#include <type_traits>
+#include <msgpack.hpp>
+#include "gossip.hpp"
+
+// Compact gossip wire format, version 2.
+//
+//   'G' 'W' version  varint(len) sender
+//   then per peer until the end of the datagram:
+//   varint(len << 1 | self) [id]  varint(heartbeat)  address
+//
+// Version 3 is the same with varint(origin) varint(hops) of the heartbeat Trace after
+// each address.
+//
+// self set means the id is the sender id from the header and no id bytes follow.
+// address is a family byte followed by 4 byte IPv4 or 16 byte IPv6 and a big endian
+// port, or family 0 with varint(len) and the address text when it is not a canonical
+// "ip:port" / "[ip6]:port". A legacy datagram is a msgpack array, it can never start
+// with 'G' (a positive fixint), so both formats are told apart by the first byte.
+namespace gossip::wire {
+constexpr char MAGIC[] = {'G', 'W'};
+constexpr std::uint8_t VERSION = 2;
+constexpr std::uint8_t VERSION_TRACED = 3;
+constexpr std::uint8_t ADDRESS_TEXT = 0;
+constexpr std::uint8_t ADDRESS_V4 = 4;
+constexpr std::uint8_t ADDRESS_V6 = 6;
+// Longest text an address is decoded into, "[ip6]:port"
+constexpr std::size_t ADDRESS_STRLEN = INET6_ADDRSTRLEN + 8;
+
+class wire_error : public std::runtime_error {
+public:
+  using std::runtime_error::runtime_error;
+};
+
+// Either version, traced or not.
+bool is_compact(const char *buf, std::size_t size);
+
+char *put_varint(char *out, std::uint64_t v);
+
+// Writes the datagram header for sender into sbuf, of VERSION_TRACED when traced.
+void encode_header(msgpack::sbuffer &sbuf, std::string_view sender, bool traced = false);
+// Bytes encode_address may write for address.
+std::size_t max_address_size(std::string_view address);
+// Writes the family byte and binary or text form of address into out. Returns the
+// bytes written. The result only depends on the address, callers may cache it.
+std::size_t encode_address(char *out, std::string_view address);
+// Bytes encode_peer may write for p, traced or not.
+std::size_t max_peer_size(const Peer &p);
+// Writes p into out, which has room for max_peer_size(p), with address as returned
+// by encode_address for p, and its trace when traced. Returns the bytes written.
+std::size_t encode_peer(char *out, const Peer &p, std::string_view sender, std::string_view address,
+                        bool traced = false);
+
+namespace detail {
+inline std::uint64_t get_varint(const char *&in, const char *end) {
+  std::uint64_t v = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    if (in==end) {
+      throw wire_error("truncated varint");
+    }
+    auto b = static_cast<std::uint8_t>(*in++);
+    v |= static_cast<std::uint64_t>(b & 0x7f) << shift;
+    if ((b & 0x80)==0) {
+      return v;
+    }
+  }
+  throw wire_error("varint too long");
+}
+
+inline const char *take(const char *&in, const char *end, std::size_t n) {
+  if (static_cast<std::size_t>(end - in) < n) {
+    throw wire_error("truncated datagram");
+  }
+  auto p = in;
+  in += n;
+  return p;
+}
+
+// Formats a binary address into buf as "ip:port" or "[ip6]:port".
+inline std::string_view format_address(int family, const char *addr, std::uint16_t port, char *buf) {
+  char *p = buf;
+  if (family==AF_INET6) {
+    *p++ = '[';
+  }
+  if (inet_ntop(family, addr, p, INET6_ADDRSTRLEN)==nullptr) {
+    throw wire_error("bad address");
+  }
+  p += std::strlen(p);
+  if (family==AF_INET6) {
+    *p++ = ']';
+  }
+  *p++ = ':';
+  p = std::to_chars(p, buf + ADDRESS_STRLEN, port).ptr;
+  return {buf, static_cast<std::size_t>(p - buf)};
+}
+
+// Reads an address written by encode_address, binary ones are formatted into text.
+inline std::string_view get_address(const char *&in, const char *end, char *text) {
+  auto family = static_cast<std::uint8_t>(*take(in, end, 1));
+  if (family==ADDRESS_TEXT) {
+    auto len = get_varint(in, end);
+    return {take(in, end, len), len};
+  }
+  if (family!=ADDRESS_V4 && family!=ADDRESS_V6) {
+    throw wire_error("unknown address family");
+  }
+  auto addr = take(in, end, family==ADDRESS_V4 ? 4 : 16);
+  auto port = take(in, end, 2);
+  auto p = static_cast<std::uint16_t>(static_cast<std::uint8_t>(port[0]) << 8 | static_cast<std::uint8_t>(port[1]));
+  return format_address(family==ADDRESS_V4 ? AF_INET : AF_INET6, addr, p, text);
+}
+} // namespace detail
+
+// Calls fn(std::string_view id, std::string_view address, unsigned int heartbeat) per
+// peer of a compact datagram, with a fourth const Trace & argument when fn takes one,
+// empty for an untraced datagram. The views are only valid during the call. Throws
+// wire_error on malformed input, peers before the error were delivered.
+// Returns the number of peers decoded.
+template<typename Function>
+std::size_t decode(const char *buf, std::size_t size, Function fn) {
+  if (!is_compact(buf, size)) {
+    throw wire_error("not a compact datagram");
+  }
+  auto traced = static_cast<std::uint8_t>(buf[2])==VERSION_TRACED;
+  const char *in = buf + 3;
+  const char *end = buf + size;
+  auto sender_len = detail::get_varint(in, end);
+  std::string_view sender{detail::take(in, end, sender_len), sender_len};
+
+  char text[ADDRESS_STRLEN];
+  std::size_t peers = 0;
+  while (in < end) {
+    auto tag = detail::get_varint(in, end);
+    std::string_view id = sender;
+    if ((tag & 1)==0) {
+      id = {detail::take(in, end, tag >> 1), tag >> 1};
+    }
+    auto hb = static_cast<unsigned int>(detail::get_varint(in, end));
+    auto address = detail::get_address(in, end, text);
+    Trace trace;
+    if (traced) {
+      trace.origin = detail::get_varint(in, end);
+      trace.hops = static_cast<std::uint32_t>(detail::get_varint(in, end));
+    }
+    if constexpr (std::is_invocable_v<Function &, std::string_view, std::string_view, unsigned int, const Trace &>) {
+      fn(id, address, hb, trace);
+    } else {
+      fn(id, address, hb);
+    }
+    ++peers;
+  }
+  return peers;
+}
+} // namespace gossip::wire
@@ -1,17 +1,23 @@
+#include <atomic>
 #include <thread>
 #include <csignal>
+#include <cstdlib>
 #include "Config.hpp"
 #include "gossip.hpp"
 #include "Client.hpp"
+#include "Export.hpp"
 #include "Listener.hpp"
+#include "Metrics.hpp"
+#include "Reactor.hpp"
+#include "Swim.hpp"
 #include "spdlog/spdlog.h"
 #include "spdlog/fmt/ostr.h"
 #include "crow_all.h"
-#include "rapidjson/prettywriter.h"
+#include "rapidjson/writer.h"
 
 std::string serialize_peers_json(const std::vector<gossip::Peer>& alive, const std::vector<gossip::Peer>& suspects) {
   rapidjson::StringBuffer sb;
-  rapidjson::PrettyWriter<rapidjson::StringBuffer> writer(sb);
+  rapidjson::Writer<rapidjson::StringBuffer> writer(sb);
 
   writer.StartObject();
   writer.String("peers");
@@ -34,6 +40,71 @@ std::string serialize_peers_json(const std::vector<gossip::Peer>& alive, const s
   return std::string(sb.GetString());
 }
 
+// /status?state=&prefix=&after=&limit=&format= serves one page of the latest snapshot,
+// after is the next field of the previous page. Big tables are read in bounded pieces
+// instead of one response holding the whole table.
+crow::response status_page(const crow::request &req, gossip::IndexCache &cache, const gossip::Members &members) {
+  gossip::SnapshotIndex::Query q;
+  if (auto state = req.url_params.get("state")) {
+    std::string_view v{state};
+    if (v=="alive") {
+      q.state = gossip::SnapshotIndex::State::alive;
+    } else if (v=="suspect") {
+      q.state = gossip::SnapshotIndex::State::suspect;
+    } else if (v!="all") {
+      return crow::response(400, "state must be all, alive or suspect");
+    }
+  }
+  if (auto limit = req.url_params.get("limit")) {
+    char *end;
+    auto v = std::strtoul(limit, &end, 10);
+    if (end==limit || *end!='\0' || v < 1 || v > gossip::SnapshotIndex::MAX_LIMIT) {
+      return crow::response(400, "limit must be a number from 1 to "
+          + std::to_string(gossip::SnapshotIndex::MAX_LIMIT));
+    }
+    q.limit = v;
+  }
+  if (auto prefix = req.url_params.get("prefix")) {
+    q.prefix = prefix;
+  }
+  if (auto after = req.url_params.get("after")) {
+    q.after = after;
+  }
+  std::string_view format{"json"};
+  if (auto f = req.url_params.get("format")) {
+    format = f;
+  }
+  if (format!="json" && format!="msgpack") {
+    return crow::response(400, "format must be json or msgpack");
+  }
+
+  auto index = cache.get(members);
+  gossip::SnapshotIndex::Page page;
+  index->page(q, page);
+  crow::response res;
+  if (format=="msgpack") {
+    msgpack::sbuffer sbuf;
+    msgpack::packer<msgpack::sbuffer> pk(sbuf);
+    gossip::pack_page(pk, page, index->version());
+    res.set_header("Content-Type", "application/x-msgpack");
+    res.write(std::string(sbuf.data(), sbuf.size()));
+  } else {
+    rapidjson::StringBuffer sb;
+    rapidjson::Writer<rapidjson::StringBuffer> writer(sb);
+    gossip::write_page(writer, page, index->version());
+    res.set_header("Content-Type", "application/json");
+    res.write(sb.GetString());
+  }
+  return res;
+}
+
+// Rendered /status response of one snapshot version, shared by every scrape until a
+// scrape sees a newer one
+struct Status {
+  std::uint64_t version;
+  std::string body;
+};
+
 int main() {
   gossip::Config config{};
 
@@ -42,8 +113,6 @@ int main() {
     return -1;
   }
 
-  static std::atomic<bool> is_running{true};
-
   auto my_id = config.get_my_id();
   auto a = gossip::Config::split(config.get_my_address(), ':');
   auto my_ip = a[0];
@@ -55,6 +124,11 @@ int main() {
   std::shared_ptr<gossip::Members> members = std::make_shared<gossip::Members>();
   members->set_tfail(1000);
   members->set_tclean(2000);
+  if (config.get_failure_detector()=="phi") {
+    auto round = std::chrono::milliseconds(members->get_tround());
+    members->set_detector(std::make_unique<gossip::PhiAccrual>(config.get_phi_threshold(), round/2,
+                                                               std::chrono::milliseconds(0), round));
+  }
   members->set_me(my_id);
   members->add_peer(me);
 
@@ -65,83 +139,235 @@ int main() {
     members->add_peer(n);
   }
 
-  std::thread listener(
-      [&] {
+  auto mtu = static_cast<std::size_t>(config.get_mtu());
+  // SWIM probes members itself, tables then only introduce members it did not hear of
+  auto swim_mode = config.get_failure_detector()=="swim";
+  gossip::Swim::Options swim_options;
+  swim_options.indirect = static_cast<unsigned int>(config.get_swim_indirect());
+  swim_options.period = std::chrono::milliseconds(members->get_tround());
+  swim_options.max_size = mtu;
+  gossip::Swim swim{*members, my_id, config.get_my_address(), swim_options};
 
-        gossip::Listener server{};
-        auto sockfd = server.create_connection(my_ip, my_port);
-        while (is_running) {
-          char buf[2048];
-          auto s = server.listen_gossip(sockfd, buf, 2048, 0);
-          auto msg = server.deserialize(buf, s);
-          for (auto &p:msg) {
-            members->heartbeat(p);
-          }
+  // Every socket and timer of the daemon is driven by one reactor thread, only
+  // LISTENERS > 1 adds receive threads on SO_REUSEPORT sockets
+  gossip::Reactor reactor;
+  gossip::ListenerPool listener{static_cast<std::size_t>(config.get_listeners()),
+                                static_cast<std::size_t>(config.get_recv_batch()), mtu};
+  gossip::Counter decode_failures;
+  auto on_datagram = [&](const char *buf, std::size_t s) {
+    try {
+      if (gossip::Swim::accepts(buf, s)) {
+        swim.receive(buf, s, std::chrono::steady_clock::now());
+        return;
+      }
+      gossip::Listener::decode(buf, s, [&](std::string_view id, std::string_view address, unsigned int hb,
+                                           const gossip::Trace &trace) {
+        if (swim_mode) {
+          swim.learn(id, address);
+        } else {
+          members->heartbeat(id, address, hb, trace);
         }
-        ::close(sockfd);
+      });
+    } catch (const std::exception &e) {
+      decode_failures.add();
+      spdlog::error("cannot decode message: {}", e.what());
+    }
+  };
+  auto io_uring = config.get_io_backend()=="io_uring";
+  if (io_uring) {
+    listener.use_io_uring();
+  }
+  if (listener.size() > 1) {
+    listener.start(my_ip, my_port, config.get_recv_buffer(), on_datagram);
+  } else {
+    listener.start(reactor, my_ip, my_port, config.get_recv_buffer(), on_datagram);
+  }
+
+  gossip::Client client{my_id, config.get_wire_version()};
+  if (io_uring) {
+    client.use_io_uring();
+  }
+  auto full_sync_rounds = static_cast<unsigned int>(config.get_full_sync_rounds());
+  auto round_robin = config.get_peer_selection()=="round_robin";
+  auto tround = std::chrono::milliseconds(members->get_tround());
+  // Reused across rounds, a steady state round does not allocate
+  std::vector<gossip::Peer> k;
+  std::vector<gossip::Peer> table;
+  msgpack::sbuffer sbuf;
+  gossip::DeltaSync delta{full_sync_rounds};
+  gossip::RoundRobin targets;
+  gossip::Histogram round_duration;
+
+  spdlog::info("Initial run, send broadcast message id:{}", my_id);
+  members->beat();
+  members->get_alive_peers(table);
+  client.send_table(sbuf, table, table, mtu);
+
+  if (swim_mode) {
+    // Probes run on a finer tick than rounds, a full table goes to one member every
+    // full_sync_rounds rounds so joining nodes learn members whose rumors died out
+    reactor.add_timer(std::chrono::milliseconds(10), [&] {
+      swim.tick(std::chrono::steady_clock::now());
+    });
+    reactor.add_timer(tround, [&] {
+      gossip::ScopedObserve observe{round_duration};
+      members->get_random_peers(1, k);
+      if (!k.empty() && delta.begin_round(*members)) {
+        members->get_alive_peers(table);
+        client.send_table(sbuf, table, k, mtu);
       }
-  );
-
-  std::thread sender([&] {
-    spdlog::info("Initial run, send broadcast message id:{}", my_id);
-    auto me = members->get_peer(my_id);
-    gossip::Client client{};
-    {
-      auto table = members->get_alive_peers();
-      me->inc_heartbeat();
-      msgpack::sbuffer sbuf;
-      auto s = client.serialize(sbuf, table);
-
-      for (const auto &p:members->get_alive_peers()) {
-        auto addr = gossip::Config::split(p.get_address(), ':');
-        client.send_members(sbuf.data(), s, addr[0], addr[1]);
+    });
+  } else {
+    // The failure detector only wakes up when the next peer deadline is due, heartbeats
+    // of new or revived peers move the timer earlier from the listener threads
+    auto cleanup = reactor.add_deadline([&] {
+      members->cleanup_task();
+    });
+    members->set_wakeup([&reactor, cleanup](gossip::Reactor::clock::time_point when) {
+      reactor.arm(cleanup, when);
+    });
+    reactor.add_timer(tround, [&] {
+      gossip::ScopedObserve observe{round_duration};
+      if (round_robin) {
+        targets.next(*members, 3, k);
+      } else {
+        members->get_random_peers(3, k);
       }
-    }
-    members->start_cleanup();
-    while (is_running) {
-      std::this_thread::sleep_for(std::chrono::milliseconds(150));
-      auto k = members->get_random_peers(3);
       if (k.empty()) {
-        continue;
+        return;
       }
-      me->inc_heartbeat();
-      auto table = members->get_alive_peers();
-      msgpack::sbuffer sbuf;
-      auto s = client.serialize(sbuf, table);
-      for (const auto &p: k) {
-        auto addr = gossip::Config::split(p.get_address(), ':');
-        client.send_members(sbuf.data(), s, std::string(addr[0]), std::string(addr[1]));
+      auto full = delta.begin_round(*members);
+      members->beat();
+      auto bytes = client.bytes_sent();
+      if (full) {
+        members->get_alive_peers(table);
+      } else {
+        delta.next(*members, table);
       }
-    }
-    members->stop_cleanup();
+      client.send_table(sbuf, table, k, mtu);
+      spdlog::debug("gossip round sent {} bytes", client.bytes_sent() - bytes);
+    });
+  }
+
+  // The reactor only swaps in a new snapshot, the body is rendered by the first scrape
+  // of each snapshot and copied out by the others, nothing is rendered while nobody
+  // scrapes. The boot time keeps an ETag from matching a response of an earlier run.
+  auto boot = std::chrono::system_clock::now().time_since_epoch().count();
+  std::shared_ptr<const Status> status;
+  members->publish();
+  reactor.add_timer(tround, [&] {
+    members->publish();
+  });
+
+  crow::SimpleApp app;
+  std::thread network([&] {
+    reactor.run();
+    app.stop();
   });
 
+  // Latched for a signal that lands before app.run() created the server, app.stop()
+  // has nothing to stop then and the server would run on
+  static std::atomic<bool> stopping{false};
+  static gossip::Reactor *running = &reactor;
   struct sigaction sigIntHandler{};
 
   void (*sig_handler)(int) = [](int s) {
-    is_running.store(false);
-    exit(0);
+    stopping.store(true);
+    running->stop();
   };
   sigIntHandler.sa_handler = sig_handler;
   sigemptyset(&sigIntHandler.sa_mask);
   sigIntHandler.sa_flags = 0;
 
   sigaction(SIGINT, &sigIntHandler, nullptr);
+  sigaction(SIGTERM, &sigIntHandler, nullptr);
 
-  crow::SimpleApp app;
   app.loglevel(crow::LogLevel::Warning);
 
+  gossip::IndexCache index_cache;
   CROW_ROUTE(app, "/status")
-      ([members] {
-        auto alive = members->get_alive_peers();
-        auto suspects = members->get_suspected_peers();
-        return serialize_peers_json(alive, suspects);
+      ([&status, &index_cache, &members, boot](const crow::request &req) {
+        for (auto param : {"state", "prefix", "after", "limit", "format"}) {
+          if (req.url_params.get(param)!=nullptr) {
+            return status_page(req, index_cache, *members);
+          }
+        }
+        auto snapshot = members->snapshot();
+        auto etag = "\"" + std::to_string(boot) + "-" + std::to_string(snapshot->version) + "\"";
+        crow::response res;
+        res.set_header("ETag", etag);
+        auto match = req.get_header_value("If-None-Match");
+        if (match=="*" || match.find(etag)!=std::string::npos) {
+          res.code = 304;
+          return res;
+        }
+        auto s = std::atomic_load(&status);
+        if (s==nullptr || s->version!=snapshot->version) {
+          auto rendered = std::make_shared<const Status>(
+              Status{snapshot->version, serialize_peers_json(snapshot->alive, snapshot->suspects)});
+          // Scrapes racing on a new snapshot may each render it, a newer one already
+          // swapped in is kept
+          if (s==nullptr || s->version < rendered->version) {
+            std::atomic_compare_exchange_strong(&status, &s, rendered);
+          }
+          s = rendered;
+        }
+        res.set_header("Content-Type", "application/json");
+        res.write(s->body);
+        return res;
       });
 
-  app.port(monit_port)
-      .multithreaded()
-      .run();
+  // Components count on their hot paths, the registry only reads them on a scrape
+  gossip::Registry registry;
+  registry.counter("gossip_bytes_sent_total", "Bytes of gossip tables sent.",
+                   [&client] { return client.bytes_sent(); });
+  registry.counter("gossip_datagrams_sent_total", "Gossip datagrams sent.",
+                   [&client] { return client.datagrams_sent(); });
+  registry.counter("gossip_datagrams_received_total", "Datagrams received, gossip and SWIM.",
+                   [&listener] { return listener.received(); });
+  registry.counter("gossip_bytes_received_total", "Bytes of datagrams received, gossip and SWIM.",
+                   [&listener] { return listener.bytes_received(); });
+  registry.counter("gossip_datagrams_truncated_total", "Datagrams larger than the MTU, skipped.",
+                   [&listener] { return listener.truncated(); });
+  registry.counter("gossip_datagrams_dropped_total", "Datagrams dropped by the kernel on a full receive buffer.",
+                   [&listener] { return listener.dropped(); });
+  registry.counter("gossip_decode_failures_total", "Datagrams that failed to decode.", decode_failures);
+  const auto &m = members->metrics();
+  registry.counter("gossip_heartbeats_applied_total", "Heartbeats that moved a peer forward.", m.heartbeats_applied);
+  registry.counter("gossip_heartbeats_stale_total", "Heartbeats not newer than the known one.", m.heartbeats_stale);
+  registry.counter("gossip_suspicions_total", "Alive peers suspected.", m.suspicions);
+  registry.counter("gossip_removals_total", "Suspects removed from the table.", m.removals);
+  registry.counter("gossip_recoveries_total", "Suspects back to alive.", m.recoveries);
+  registry.gauge("gossip_members_alive", "Alive members in the table.",
+                 [&members] { return static_cast<std::uint64_t>(members->size()); });
+  registry.histogram("gossip_round_duration_seconds", "Time spent in a gossip round.", round_duration);
+  registry.histogram("gossip_cleanup_duration_seconds", "Time spent in a failure detector tick.", m.cleanup_duration);
+  registry.histogram("gossip_dissemination_delay_seconds",
+                     "Time from a traced heartbeat increment on its origin to it being applied here.",
+                     m.dissemination_delay);
+  registry.histogram("gossip_dissemination_hops", "Gossip hops of the traced heartbeats applied here.",
+                     m.dissemination_hops);
+  registry.counter("swim_bytes_sent_total", "Bytes of SWIM messages sent.", [&swim] { return swim.bytes_sent(); });
+  registry.counter("swim_probes_total", "Direct probes sent.", [&swim] { return swim.probes(); });
+  registry.counter("swim_indirect_probes_total", "Indirect probes requested.",
+                   [&swim] { return swim.indirect_probes(); });
+  registry.counter("swim_suspicions_total", "Members suspected by SWIM.", [&swim] { return swim.suspicions(); });
+  registry.gauge("swim_incarnation", "Incarnation of this member.", [&swim] { return swim.incarnation(); });
+
+  CROW_ROUTE(app, "/metrics")
+      ([&registry] {
+        crow::response res{registry.text()};
+        res.set_header("Content-Type", "text/plain; version=0.0.4");
+        return res;
+      });
+
+  if (!stopping.load()) {
+    app.port(monit_port)
+        .multithreaded()
+        .run();
+  }
 
-  listener.join();
-  sender.join();
+  reactor.stop();
+  network.join();
+  listener.stop();
 }
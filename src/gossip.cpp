@@ -2,6 +2,8 @@
 #include <utility>
 #include <random>
 #include <algorithm>
+#include <cmath>
+#include <stdexcept>
 #include "gossip.hpp"
 #include "spdlog/spdlog.h"
 #include "spdlog/fmt/ostr.h"
@@ -11,27 +13,42 @@ namespace gossip {
 Peer::Peer(std::string peer_id, std::string peer_address)
     : id_(std::move(peer_id)), address_(std::move(peer_address)) {}
 
-std::string Peer::get_address() const { return address_; }
+const std::string &Peer::get_address() const { return address_; }
 
-std::string Peer::get_id() const { return id_; }
+const std::string &Peer::get_id() const { return id_; }
+
+peer_handle Peer::get_handle() const { return handle_; }
+
+peer_handle Peer::get_address_handle() const { return address_handle_; }
+
+void Peer::set_handles(peer_handle id, peer_handle address) {
+  handle_ = id;
+  address_handle_ = address;
+}
 
 unsigned int Peer::get_heartbeat() const {
-  std::lock_guard<std::mutex> lock(g_i_mutex);
-  return heartbeat_;
+  return heartbeat_.load(std::memory_order_relaxed);
 }
 
 void Peer::heartbeat(unsigned int i) {
-  std::lock_guard<std::mutex> lock(g_i_mutex);
-  heartbeat_ = i;
+  heartbeat_.store(i, std::memory_order_relaxed);
 }
 
 void Peer::inc_heartbeat() {
-  std::lock_guard<std::mutex> lock(g_i_mutex);
-  ++heartbeat_;
+  heartbeat_.fetch_add(1, std::memory_order_relaxed);
+}
+
+Trace Peer::get_trace() const {
+  return Trace{trace_origin_.load(std::memory_order_relaxed), trace_hops_.load(std::memory_order_relaxed)};
+}
+
+void Peer::set_trace(const Trace &trace) {
+  trace_origin_.store(trace.origin, std::memory_order_relaxed);
+  trace_hops_.store(trace.hops, std::memory_order_relaxed);
 }
 
 bool operator>(const Peer &lhs, const Peer &rhs) {
-  return lhs.heartbeat_ > rhs.heartbeat_;
+  return lhs.get_heartbeat() > rhs.get_heartbeat();
 }
 
 bool operator<(const Peer &lhs, const Peer &rhs) {
@@ -47,48 +64,239 @@ bool operator!=(const Peer &lhs, const Peer &rhs) {
 }
 
 void Peer::update_timestamp(int tround) {
-  std::lock_guard<std::mutex> lock(g_i_mutex);
-  m_timestamp_ = std::chrono::steady_clock::now() + std::chrono::milliseconds(tround);
+  update_timestamp(std::chrono::steady_clock::now() + std::chrono::milliseconds(tround));
+}
+
+void Peer::update_timestamp(std::chrono::steady_clock::time_point ts) {
+  m_timestamp_.store(ts.time_since_epoch().count(), std::memory_order_relaxed);
+}
+
+bool Peer::update_heartbeat(unsigned int i, std::chrono::steady_clock::time_point ts) {
+  auto current = heartbeat_.load(std::memory_order_relaxed);
+  do {
+    if (i <= current) {
+      return false;
+    }
+  } while (!heartbeat_.compare_exchange_weak(current, i, std::memory_order_relaxed));
+  update_timestamp(ts);
+  return true;
 }
 
 std::chrono::time_point<std::chrono::steady_clock> Peer::get_timestamp() const {
-  std::lock_guard<std::mutex> lock(g_i_mutex);
-  return m_timestamp_;
+  return std::chrono::time_point<std::chrono::steady_clock>(
+      std::chrono::steady_clock::duration(m_timestamp_.load(std::memory_order_relaxed)));
 }
 
 Peer &Peer::operator=(Peer const &other) {
-  std::unique_lock<std::mutex> lock_this(g_i_mutex, std::defer_lock);
-  std::unique_lock<std::mutex> lock_other(other.g_i_mutex, std::defer_lock);
-  std::lock(lock_this, lock_other);
-
   id_ = other.id_;
   address_ = other.address_;
-  heartbeat_ = other.heartbeat_;
-  m_timestamp_ = other.m_timestamp_;
+  heartbeat_.store(other.get_heartbeat(), std::memory_order_relaxed);
+  m_timestamp_.store(other.m_timestamp_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+  set_trace(other.get_trace());
+  handle_ = other.handle_;
+  address_handle_ = other.address_handle_;
 
   return *this;
 }
 
-Peer::Peer(Peer const &other) {
-  std::unique_lock<std::mutex> lock_other(other.g_i_mutex);
-  id_ = other.id_;
-  address_ = other.address_;
-  heartbeat_ = other.heartbeat_;
-  m_timestamp_ = other.m_timestamp_;
+Peer &Peer::operator=(Peer &&other) noexcept {
+  id_ = std::move(other.id_);
+  address_ = std::move(other.address_);
+  heartbeat_.store(other.get_heartbeat(), std::memory_order_relaxed);
+  m_timestamp_.store(other.m_timestamp_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+  set_trace(other.get_trace());
+  handle_ = other.handle_;
+  address_handle_ = other.address_handle_;
+
+  return *this;
+}
+
+Peer::Peer(Peer const &other)
+    : id_(other.id_), address_(other.address_),
+      m_timestamp_(other.m_timestamp_.load(std::memory_order_relaxed)),
+      heartbeat_(other.get_heartbeat()),
+      trace_origin_(other.trace_origin_.load(std::memory_order_relaxed)),
+      trace_hops_(other.trace_hops_.load(std::memory_order_relaxed)),
+      handle_(other.handle_), address_handle_(other.address_handle_) {}
+
+Peer::Peer(Peer &&other) noexcept
+    : id_(std::move(other.id_)), address_(std::move(other.address_)),
+      m_timestamp_(other.m_timestamp_.load(std::memory_order_relaxed)),
+      heartbeat_(other.get_heartbeat()),
+      trace_origin_(other.trace_origin_.load(std::memory_order_relaxed)),
+      trace_hops_(other.trace_hops_.load(std::memory_order_relaxed)),
+      handle_(other.handle_), address_handle_(other.address_handle_) {}
+
+peer_handle Interner::intern(std::string_view s) {
+  {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    auto it = handles_.find(s);
+    if (it!=handles_.end()) {
+      return it->second;
+    }
+  }
+  std::unique_lock<std::shared_mutex> lock(mutex_);
+  auto it = handles_.find(s);
+  if (it!=handles_.end()) {
+    return it->second;
+  }
+  auto h = static_cast<peer_handle>(strings_.size());
+  strings_.emplace_back(s);
+  handles_.emplace(strings_.back(), h);
+  return h;
+}
+
+peer_handle Interner::find(std::string_view s) const {
+  std::shared_lock<std::shared_mutex> lock(mutex_);
+  auto it = handles_.find(s);
+  return it==handles_.end() ? no_handle : it->second;
+}
+
+const std::string &Interner::get(peer_handle h) const {
+  std::shared_lock<std::shared_mutex> lock(mutex_);
+  return strings_.at(h);
+}
+
+std::size_t Interner::size() const {
+  std::shared_lock<std::shared_mutex> lock(mutex_);
+  return strings_.size();
 }
 
 std::ostream &operator<<(std::ostream &strm, const Peer &peer) {
   return strm << R"("peer":{ "id": )" << peer.id_
               << R"(, "address": )" << "\"" << peer.address_ << "\""
-              << R"(, "heartbeat": )" << peer.heartbeat_
+              << R"(, "heartbeat": )" << peer.get_heartbeat()
               << "}";
 }
 
-Members::Members() = default;
+FixedTimeout::FixedTimeout(std::chrono::milliseconds timeout) : timeout_(timeout) {}
+
+void FixedTimeout::heartbeat(peer_handle, clock::time_point) {}
+
+FailureDetector::clock::time_point FixedTimeout::deadline(peer_handle, clock::time_point timestamp) const {
+  return timestamp + timeout_;
+}
+
+void FixedTimeout::remove(peer_handle) {}
+
+namespace {
+using millis = std::chrono::duration<double, std::milli>;
+}
+
+PhiAccrual::PhiAccrual(double threshold, std::chrono::milliseconds min_std, std::chrono::milliseconds pause,
+                       std::chrono::milliseconds first_interval)
+    : threshold_(threshold),
+      min_std_(static_cast<double>(min_std.count())),
+      pause_(static_cast<double>(pause.count())),
+      first_interval_(static_cast<double>(first_interval.count())) {
+  // phi grows monotonically with y, find where it crosses threshold once
+  double lo = 0, hi = 1;
+  while (phi(hi) < threshold_ && hi < 1e3) {
+    hi *= 2;
+  }
+  for (int i = 0; i < 64; ++i) {
+    auto mid = (lo + hi)/2;
+    (phi(mid) < threshold_ ? lo : hi) = mid;
+  }
+  y_ = hi;
+}
+
+// Logistic approximation of the normal cdf, as used by Akka and Cassandra
+double PhiAccrual::phi(double y) {
+  auto e = std::exp(-y*(1.5976 + 0.070566*y*y));
+  if (y > 0) {
+    return -std::log10(e/(1.0 + e));
+  }
+  return -std::log10(1.0 - 1.0/(1.0 + e));
+}
+
+void PhiAccrual::History::add(double interval) {
+  if (count==WINDOW) {
+    sum -= intervals[next];
+    squares -= intervals[next]*intervals[next];
+  } else {
+    ++count;
+  }
+  intervals[next] = interval;
+  sum += interval;
+  squares += interval*interval;
+  next = (next + 1)%WINDOW;
+}
+
+double PhiAccrual::History::mean() const {
+  return sum/static_cast<double>(count);
+}
+
+double PhiAccrual::History::std_dev(double min_std) const {
+  auto m = mean();
+  auto variance = squares/static_cast<double>(count) - m*m;
+  return std::max(std::sqrt(std::max(variance, 0.0)), min_std);
+}
+
+void PhiAccrual::heartbeat(peer_handle h, clock::time_point now) {
+  auto &s = shards_[h%shards_.size()];
+  std::unique_lock<std::mutex> lock(s.mutex_);
+  auto[it, added] = s.peers_.try_emplace(h);
+  auto &history = it->second;
+  if (added) {
+    // Seed with first_interval and a deviation of a quarter of it
+    history.add(first_interval_*0.75);
+    history.add(first_interval_*1.25);
+  } else {
+    history.add(std::max(millis(now - history.last).count(), 0.0));
+  }
+  history.last = now;
+}
+
+FailureDetector::clock::time_point PhiAccrual::deadline(peer_handle h, clock::time_point timestamp) const {
+  auto &s = shards_[h%shards_.size()];
+  std::unique_lock<std::mutex> lock(s.mutex_);
+  auto it = s.peers_.find(h);
+  if (it==s.peers_.end()) {
+    auto dev = std::max(first_interval_/4, min_std_);
+    return timestamp + std::chrono::duration_cast<clock::duration>(millis(first_interval_ + pause_ + y_*dev));
+  }
+  const auto &history = it->second;
+  auto wait = history.mean() + pause_ + y_*history.std_dev(min_std_);
+  return history.last + std::chrono::duration_cast<clock::duration>(millis(wait));
+}
+
+void PhiAccrual::remove(peer_handle h) {
+  auto &s = shards_[h%shards_.size()];
+  std::unique_lock<std::mutex> lock(s.mutex_);
+  s.peers_.erase(h);
+}
+
+double PhiAccrual::phi(peer_handle h, clock::time_point now) const {
+  auto &s = shards_[h%shards_.size()];
+  std::unique_lock<std::mutex> lock(s.mutex_);
+  auto it = s.peers_.find(h);
+  if (it==s.peers_.end()) {
+    return 0;
+  }
+  const auto &history = it->second;
+  auto elapsed = millis(now - history.last).count();
+  return phi((elapsed - history.mean() - pause_)/history.std_dev(min_std_));
+}
+
+MembersMetrics::MembersMetrics()
+    : dissemination_delay({std::chrono::milliseconds(10), std::chrono::milliseconds(25),
+                           std::chrono::milliseconds(50), std::chrono::milliseconds(100),
+                           std::chrono::milliseconds(250), std::chrono::milliseconds(500),
+                           std::chrono::seconds(1), std::chrono::seconds(2), std::chrono::seconds(5),
+                           std::chrono::seconds(10), std::chrono::seconds(30)}),
+      dissemination_hops(std::vector<std::uint64_t>{1, 2, 3, 4, 5, 6, 8, 10, 12, 16}) {}
+
+Members::Members()
+    : trace_now_([] {
+  auto now = std::chrono::system_clock::now().time_since_epoch();
+  return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(now).count());
+}) {}
 
 Members::~Members() {
   if (t_!=nullptr) {
     cleanup_is_running.store(false);
+    timers_.notify();
     if (t_->joinable()) {
       t_->join();
     }
@@ -96,126 +304,414 @@ Members::~Members() {
 }
 
 void Members::set_tfail(int t) {
-  tfail_ = t;
+  detector_ = std::make_unique<FixedTimeout>(std::chrono::milliseconds(t));
 }
 
 void Members::set_tclean(int t) {
   tcleanup_ = t;
 }
 
+void Members::set_detector(std::unique_ptr<FailureDetector> detector) {
+  detector_ = std::move(detector);
+}
+
+void Members::set_clock(std::function<FailureDetector::clock::time_point()> now) {
+  now_ = std::move(now);
+  // Deadlines are rounded to ticks counted from the injected clock, not from when we were built
+  timers_.restart(now_());
+}
+
+void Members::set_trace_clock(std::function<std::uint64_t()> now) {
+  trace_now_ = std::move(now);
+}
+
+void Members::set_wakeup(std::function<void(FailureDetector::clock::time_point)> wakeup) {
+  wakeup_ = std::move(wakeup);
+  wake();
+}
+
+void Members::wake() {
+  std::unique_lock<std::mutex> lock(wakeup_mutex_);
+  wakeup_(timers_.watch());
+}
+
 void Members::deadline(const std::string &id) {
-  if (members_->is_alive(id)) {
-    spdlog::info("Suspected peer: {}", *members_->get_peer(id));
-    auto peer = members_->get_peer(id);
-    peer->update_timestamp(tround_);
-    members_->to_suspected(id);
+  deadline(members_->handle(id));
+}
+
+void Members::deadline(peer_handle h) {
+  if (auto peer = members_->transition(h, PeerState::alive, PeerState::suspect)) {
+    spdlog::info("Suspected peer: {}", *peer);
+    metrics_.suspicions.add();
+    peer->update_timestamp(now_() + std::chrono::milliseconds(tround_));
   }
 }
 
 void Members::cleanup(const std::string &id) {
-  if (members_->is_dead(id)) {
-    spdlog::info("Remove peer: {}", *members_->get_suspect(id));
-    members_->cleanup(id);
+  cleanup(members_->handle(id));
+}
+
+void Members::cleanup(peer_handle h) {
+  if (auto peer = members_->cleanup(h)) {
+    spdlog::info("Remove peer: {}", *peer);
+    metrics_.removals.add();
+    detector_->remove(h);
+  }
+}
+
+void Members::refute(peer_handle h) {
+  if (auto peer = members_->transition(h, PeerState::suspect, PeerState::alive)) {
+    spdlog::info("Peer refuted suspicion: {}", *peer);
+    metrics_.recoveries.add();
+    auto now = now_();
+    peer->update_timestamp(now + std::chrono::milliseconds(tround_));
+    detector_->heartbeat(h, now);
+    arm(h);
   }
 }
 
 void Members::heartbeat(Peer &peer) {
-  auto id = peer.get_id();
-  if (members_->is_alive(id)) {
-    auto peer_existing = members_->get_peer(id);
-    if (*peer_existing < peer) {
-      peer_existing->update_timestamp(tround_);
-      peer_existing->heartbeat(peer.get_heartbeat());
-    }
-  } else if (members_->is_dead(id)) {
-    auto peer_existing = members_->get_suspect(id);
-    if (*peer_existing < peer) {
-      spdlog::info("Heard from suspected peer: {}", peer);
-      peer_existing->update_timestamp(tround_);
-      peer_existing->heartbeat(peer.get_heartbeat());
-      members_->to_alive(id);
+  heartbeat(peer.get_id(), peer.get_address(), peer.get_heartbeat(), peer.get_trace());
+}
+
+void Members::heartbeat(std::string_view id, std::string_view address, unsigned int heartbeat,
+                        const Trace &trace) {
+  auto now = now_();
+  peer_handle h = no_handle;
+  auto hop = trace.origin==0 ? Trace{} : Trace{trace.origin, trace.hops + 1};
+  auto result = members_->heartbeat(id, address, heartbeat, now + std::chrono::milliseconds(tround_), &h, hop);
+  if (result==MembersTable::Heartbeat::stale) {
+    metrics_.heartbeats_stale.add();
+    return;
+  }
+  metrics_.heartbeats_applied.add();
+  if (hop.origin!=0) {
+    auto at = trace_now_();
+    metrics_.dissemination_delay.observe(std::chrono::microseconds(at > hop.origin ? at - hop.origin : 0));
+    metrics_.dissemination_hops.observe(std::uint64_t{hop.hops});
+  }
+  detector_->heartbeat(h, now);
+  switch (result) {
+  case MembersTable::Heartbeat::added:
+    spdlog::info("New peer found: id: {}, address: {}, heartbeat: {}", id, address, heartbeat);
+    arm(h);
+    break;
+  case MembersTable::Heartbeat::revived:
+    spdlog::info("Heard from suspected peer: id: {}, heartbeat: {}", id, heartbeat);
+    metrics_.recoveries.add();
+    // The removal deadline may be far out, bring the failure deadline back
+    arm(h);
+    break;
+  default:
+    break;
+  }
+}
+
+MembersTable::Shard &MembersTable::shard(peer_handle h) {
+  return shards_[h%SHARDS];
+}
+
+const MembersTable::Shard &MembersTable::shard(peer_handle h) const {
+  return shards_[h%SHARDS];
+}
+
+peer_handle MembersTable::intern(std::string_view id) {
+  return ids_.intern(id);
+}
+
+peer_handle MembersTable::handle(std::string_view id) const {
+  return ids_.find(id);
+}
+
+const std::string &MembersTable::name(peer_handle h) const {
+  return ids_.get(h);
+}
+
+std::uint64_t MembersTable::next_version() {
+  return version_.fetch_add(1, std::memory_order_relaxed) + 1;
+}
+
+void AliveIndex::insert(peer_handle h) {
+  std::unique_lock<std::mutex> lock(m_);
+  if (h >= index_.size()) {
+    index_.resize(h + 1, none);
+  }
+  if (index_[h]!=none) {
+    return;
+  }
+  index_[h] = static_cast<std::uint32_t>(handles_.size());
+  handles_.push_back(h);
+}
+
+void AliveIndex::erase(peer_handle h) {
+  std::unique_lock<std::mutex> lock(m_);
+  if (h >= index_.size() || index_[h]==none) {
+    return;
+  }
+  auto pos = index_[h];
+  auto last = handles_.back();
+  handles_[pos] = last;
+  index_[last] = pos;
+  handles_.pop_back();
+  index_[h] = none;
+}
+
+std::size_t AliveIndex::size() const {
+  std::unique_lock<std::mutex> lock(m_);
+  return handles_.size();
+}
+
+void AliveIndex::sample(std::size_t k, peer_handle skip, std::mt19937 &gen, std::vector<peer_handle> &out) const {
+  out.clear();
+  std::unique_lock<std::mutex> lock(m_);
+  auto skip_pos = skip < index_.size() ? index_[skip] : none;
+  std::size_t n = handles_.size() - (skip_pos!=none);
+  k = std::min(k, n);
+  // Floyd's algorithm draws k distinct positions out of n with k draws. Positions
+  // of the sample are kept in out, the linear lookup is cheap for fan-out sized k.
+  for (auto j = n - k; j < n; ++j) {
+    std::uniform_int_distribution<std::size_t> d(0, j);
+    auto t = static_cast<peer_handle>(d(gen));
+    if (std::find(out.begin(), out.end(), t)!=out.end()) {
+      t = static_cast<peer_handle>(j);
     }
-  } else {
-    spdlog::info("New peer found: {}", peer);
-    peer.update_timestamp(tround_);
-    members_->add_peer(peer);
+    out.push_back(t);
+  }
+  // Positions count past skip, which is left out of the draw
+  for (auto &p : out) {
+    p = handles_[skip_pos!=none && p >= skip_pos ? p + 1 : p];
   }
 }
 
-void MembersTable::to_suspected(const std::string &id) {
-  if (is_alive(id)) {
-    std::unique_lock<std::mutex> lock(m_members_mutex);
-    auto &p = alive_.at(id);
-    dead_.insert({id, p});
-    alive_.erase(id);
+void AliveIndex::handles(std::vector<peer_handle> &out) const {
+  std::unique_lock<std::mutex> lock(m_);
+  out.assign(handles_.begin(), handles_.end());
+}
+
+std::shared_ptr<Peer> MembersTable::transition(peer_handle h, PeerState from, PeerState to) {
+  if (h==no_handle) {
+    return nullptr;
+  }
+  auto &s = shard(h);
+  std::unique_lock<std::mutex> lock(s.m_members_mutex);
+  auto it = s.peers_.find(h);
+  if (it==s.peers_.end() || it->second.state!=from) {
+    return nullptr;
+  }
+  it->second.state = to;
+  it->second.changed = next_version();
+  if (from==PeerState::alive) {
+    alive_.erase(h);
+  } else if (to==PeerState::alive) {
+    alive_.insert(h);
+  }
+  return it->second.peer;
+}
+
+void MembersTable::to_suspected(peer_handle h) {
+  transition(h, PeerState::alive, PeerState::suspect);
+}
+
+void MembersTable::to_alive(peer_handle h) {
+  transition(h, PeerState::suspect, PeerState::alive);
+}
+
+MembersTable::Heartbeat MembersTable::heartbeat(Peer &peer, std::chrono::steady_clock::time_point timestamp,
+                                                peer_handle *handle) {
+  return heartbeat(peer.get_id(), peer.get_address(), peer.get_heartbeat(), timestamp, handle);
+}
+
+MembersTable::Heartbeat MembersTable::heartbeat(std::string_view id, std::string_view address,
+                                                unsigned int heartbeat,
+                                                std::chrono::steady_clock::time_point timestamp,
+                                                peer_handle *handle, const Trace &trace) {
+  auto h = ids_.intern(id);
+  if (handle!=nullptr) {
+    *handle = h;
+  }
+  auto &s = shard(h);
+  std::unique_lock<std::mutex> lock(s.m_members_mutex);
+  auto it = s.peers_.find(h);
+  if (it==s.peers_.end()) {
+    auto peer = std::make_shared<Peer>(std::string(id), std::string(address));
+    peer->heartbeat(heartbeat);
+    peer->set_trace(trace);
+    peer->set_handles(h, ids_.intern(address));
+    peer->update_timestamp(timestamp);
+    s.peers_.emplace(h, Entry{std::move(peer), PeerState::alive, next_version()});
+    alive_.insert(h);
+    return Heartbeat::added;
+  }
+  auto &e = it->second;
+  if (!e.peer->update_heartbeat(heartbeat, timestamp)) {
+    return Heartbeat::stale;
   }
+  e.peer->set_trace(trace);
+  e.changed = next_version();
+  if (e.state==PeerState::suspect) {
+    e.state = PeerState::alive;
+    alive_.insert(h);
+    return Heartbeat::revived;
+  }
+  return Heartbeat::updated;
+}
+
+void MembersTable::inc_heartbeat(peer_handle h, const Trace &trace) {
+  if (h==no_handle) {
+    return;
+  }
+  auto &s = shard(h);
+  std::unique_lock<std::mutex> lock(s.m_members_mutex);
+  auto it = s.peers_.find(h);
+  if (it!=s.peers_.end()) {
+    it->second.peer->inc_heartbeat();
+    it->second.peer->set_trace(trace);
+    it->second.changed = next_version();
+  }
+}
+
+bool MembersTable::is_alive(peer_handle h) const {
+  return find(h).second;
+}
+
+bool MembersTable::is_dead(peer_handle h) const {
+  auto[peer, alive] = find(h);
+  return peer!=nullptr && !alive;
 }
 
-void MembersTable::to_alive(const std::string &id) {
-  if (is_dead(id)) {
-    {
-      std::unique_lock<std::mutex> lock(m_members_mutex);
-      auto &p = dead_.at(id);
-      alive_.insert({id, p});
-      dead_.erase(id);
+std::pair<std::shared_ptr<Peer>, bool> MembersTable::find(peer_handle h) const {
+  if (h==no_handle) {
+    return {nullptr, false};
+  }
+  auto &s = shard(h);
+  std::unique_lock<std::mutex> lock(s.m_members_mutex);
+  auto it = s.peers_.find(h);
+  if (it==s.peers_.cend()) {
+    return {nullptr, false};
+  }
+  return {it->second.peer, it->second.state==PeerState::alive};
+}
+
+void MembersTable::snapshot(PeerState state, std::uint64_t since, std::vector<Peer> &out) const {
+  std::size_t n = 0;
+  for (const auto &s : shards_) {
+    std::unique_lock<std::mutex> lock(s.m_members_mutex);
+    for (const auto &p : s.peers_) {
+      if (p.second.state!=state || p.second.changed <= since) {
+        continue;
+      }
+      // Assigning over an existing Peer reuses its string buffers
+      if (n < out.size()) {
+        out[n] = *p.second.peer;
+      } else {
+        out.push_back(*p.second.peer);
+      }
+      ++n;
     }
   }
+  out.erase(out.begin() + n, out.end());
 }
 
-bool MembersTable::is_alive(const std::string &id) const {
-  std::unique_lock<std::mutex> lock(m_members_mutex);
-  return alive_.find(id)!=alive_.cend();
+std::vector<peer_handle> MembersTable::handles(PeerState state) const {
+  std::vector<peer_handle> v;
+  handles(state, v);
+  return v;
 }
 
-bool MembersTable::is_dead(const std::string &id) const {
-  std::unique_lock<std::mutex> lock(m_members_mutex);
-  return dead_.find(id)!=dead_.cend();
+void MembersTable::handles(PeerState state, std::vector<peer_handle> &out) const {
+  if (state==PeerState::alive) {
+    alive_.handles(out);
+    return;
+  }
+  out.clear();
+  for (const auto &s : shards_) {
+    std::unique_lock<std::mutex> lock(s.m_members_mutex);
+    for (const auto &p : s.peers_) {
+      if (p.second.state==state) {
+        out.push_back(p.first);
+      }
+    }
+  }
 }
 
 std::vector<Peer> MembersTable::get_alive_peers() const {
-  std::unique_lock<std::mutex> lock(m_members_mutex);
   std::vector<Peer> v;
-  v.reserve(alive_.size());
-  for (const auto &p : alive_) {
-    v.emplace_back(*p.second);
-  }
+  snapshot(PeerState::alive, 0, v);
   return v;
 }
 
+void MembersTable::get_alive_peers(std::vector<Peer> &out) const {
+  snapshot(PeerState::alive, 0, out);
+}
+
+std::uint64_t MembersTable::version() const {
+  return version_.load(std::memory_order_relaxed);
+}
+
+std::uint64_t MembersTable::get_alive_peers_since(std::uint64_t since, std::vector<Peer> &out) const {
+  auto version = version_.load(std::memory_order_relaxed);
+  snapshot(PeerState::alive, since, out);
+  return version;
+}
+
+void MembersTable::sample(std::size_t k, peer_handle skip, std::mt19937 &gen, std::vector<peer_handle> &out) const {
+  alive_.sample(k, skip, gen, out);
+}
+
 int MembersTable::size() const {
-  std::unique_lock<std::mutex> lock(m_members_mutex);
-  return alive_.size();
+  return static_cast<int>(alive_.size());
 }
 
 std::vector<Peer> MembersTable::get_suspected_peers() const {
-  std::unique_lock<std::mutex> lock(m_members_mutex);
   std::vector<Peer> v;
-  v.reserve(dead_.size());
-  for (const auto &p : dead_) {
-    v.emplace_back(*p.second);
-  }
+  snapshot(PeerState::suspect, 0, v);
   return v;
 }
 
+void MembersTable::get_suspected_peers(std::vector<Peer> &out) const {
+  snapshot(PeerState::suspect, 0, out);
+}
+
 void MembersTable::add_peer(Peer &peer) {
-  std::unique_lock<std::mutex> lock(m_members_mutex);
-  alive_.emplace(peer.get_id(), std::make_shared<Peer>(peer));
+  auto h = ids_.intern(peer.get_id());
+  peer.set_handles(h, ids_.intern(peer.get_address()));
+  auto &s = shard(h);
+  std::unique_lock<std::mutex> lock(s.m_members_mutex);
+  if (s.peers_.emplace(h, Entry{std::make_shared<Peer>(peer), PeerState::alive, next_version()}).second) {
+    alive_.insert(h);
+  }
 }
 
-std::shared_ptr<Peer> MembersTable::get_suspect(const std::string &id) {
-  std::unique_lock<std::mutex> lock(m_members_mutex);
-  return dead_.at(id);
+std::shared_ptr<Peer> MembersTable::get_suspect(peer_handle h) {
+  auto[peer, alive] = find(h);
+  if (peer==nullptr || alive) {
+    throw std::out_of_range("no suspected peer");
+  }
+  return peer;
 }
-std::shared_ptr<Peer> MembersTable::get_peer(const std::string &id) {
-  std::unique_lock<std::mutex> lock(m_members_mutex);
-  return alive_.at(id);
+std::shared_ptr<Peer> MembersTable::get_peer(peer_handle h) {
+  auto[peer, alive] = find(h);
+  if (!alive) {
+    throw std::out_of_range("no alive peer");
+  }
+  return peer;
 }
 
-void MembersTable::cleanup(const std::string &id) {
-  if (is_alive(id))
-    return;
-  std::unique_lock<std::mutex> lock(m_members_mutex);
-  dead_.erase(id);
+std::shared_ptr<Peer> MembersTable::cleanup(peer_handle h) {
+  if (h==no_handle) {
+    return nullptr;
+  }
+  auto &s = shard(h);
+  std::unique_lock<std::mutex> lock(s.m_members_mutex);
+  auto it = s.peers_.find(h);
+  if (it==s.peers_.end() || it->second.state!=PeerState::suspect) {
+    return nullptr;
+  }
+  auto peer = std::move(it->second.peer);
+  s.peers_.erase(it);
+  // Nothing is left to carry a change stamp, snapshots still have to notice
+  next_version();
+  return peer;
 }
 
 MembersTable::MembersTable() = default;
@@ -228,34 +724,51 @@ void Members::gossip() {
   //  }
 }
 
-void Members::cleanup_task() {
-  for (const auto &p:members_->get_suspected_peers()) {
-    if (p.get_id()==me_)
-      continue;
+FailureDetector::clock::time_point Members::due(const Peer &peer, peer_handle h, bool alive) const {
+  if (alive) {
+    return detector_->deadline(h, peer.get_timestamp());
+  }
+  return peer.get_timestamp() + std::chrono::milliseconds(tcleanup_);
+}
 
-    auto ts = p.get_timestamp() + std::chrono::milliseconds(tcleanup_);
-    auto now = (std::chrono::steady_clock::now());
-    if (ts < now) {
-      cleanup(p.get_id());
-    }
+void Members::arm(peer_handle h) {
+  auto[peer, alive] = members_->find(h);
+  if (peer==nullptr || h==me_) {
+    return;
+  }
+  if (timers_.schedule(h, due(*peer, h, alive)) && wakeup_) {
+    wake();
   }
+}
 
-  for (auto &p:members_->get_alive_peers()) {
-    if (p.get_id()==me_)
-      continue;
-    auto ts = p.get_timestamp() + std::chrono::milliseconds(tfail_);
-    auto now = std::chrono::steady_clock::now();
-    if (ts < now) {
-      deadline(p.get_id());
+void Members::expire(peer_handle h) {
+  auto[peer, alive] = members_->find(h);
+  if (peer==nullptr || h==me_) {
+    return;
+  }
+  if (due(*peer, h, alive) <= now_()) {
+    if (alive) {
+      deadline(h);
+    } else {
+      cleanup(h);
     }
   }
+  arm(h);
+}
+
+void Members::cleanup_task() {
+  ScopedObserve observe{metrics_.cleanup_duration};
+  timers_.advance(now_(), [this](peer_handle h) { expire(h); });
+  if (wakeup_) {
+    wake();
+  }
 }
 
 void Members::start_cleanup() {
   cleanup_is_running.store(true);
   t_ = std::make_unique<std::thread>([this]() {
     while (cleanup_is_running.load()) {
-      std::this_thread::sleep_until(std::chrono::steady_clock::now() + std::chrono::milliseconds(50));
+      timers_.wait();
       cleanup_task();
     }
   });
@@ -263,6 +776,7 @@ void Members::start_cleanup() {
 
 void Members::stop_cleanup() {
   cleanup_is_running.store(false);
+  timers_.notify();
   if (t_->joinable()) {
     t_->join();
   }
@@ -273,65 +787,132 @@ int Members::size() const {
 }
 
 std::vector<Peer> Members::get_random_peers(unsigned int k) const {
-  std::vector<Peer> a = members_->get_alive_peers();
-  if (a.empty() || k < 0) {
-    return std::vector<Peer>{};
-  }
   std::vector<Peer> p;
-  p.reserve(k);
-
-  std::random_device rd;
-  auto gen = std::mt19937(rd());
+  get_random_peers(k, p);
+  return p;
+}
 
-  auto c = a.size() - 1;
-  auto x = k;
-  if (k > c) {
-    x = c;
-  }
+void Members::get_random_peers(unsigned int k, std::vector<Peer> &out) const {
+  thread_local std::vector<peer_handle> a;
+  thread_local std::mt19937 gen{std::random_device{}()};
 
-  for (auto i = x; i > 0; --i) {
-    std::uniform_int_distribution<int> d(0, c);
-    auto n = a[d(gen)];
-    if (n.get_id()==me_)
+  members_->sample(k, me_, gen, a);
+  std::size_t n = 0;
+  for (auto h : a) {
+    auto[peer, alive] = members_->find(h);
+    // Left alive between the draw and the lookup
+    if (!alive) {
       continue;
-    p.push_back(n);
+    }
+    if (n < out.size()) {
+      out[n] = *peer;
+    } else {
+      out.push_back(*peer);
+    }
+    ++n;
   }
-  return p;
+  out.erase(out.begin() + n, out.end());
+}
+
+void Members::get_alive_handles(std::vector<peer_handle> &out) const {
+  members_->handles(PeerState::alive, out);
+  out.erase(std::remove(out.begin(), out.end(), me_), out.end());
+}
+
+std::pair<std::shared_ptr<Peer>, bool> Members::find(peer_handle h) const {
+  return members_->find(h);
 }
 
 std::vector<Peer> Members::get_alive_peers() const {
   return members_->get_alive_peers();
 }
 
+void Members::get_alive_peers(std::vector<Peer> &out) const {
+  members_->get_alive_peers(out);
+}
+
+std::uint64_t Members::get_alive_peers_since(std::uint64_t since, std::vector<Peer> &out) const {
+  return members_->get_alive_peers_since(since, out);
+}
+
+std::uint64_t Members::version() const {
+  return members_->version();
+}
+
 std::vector<Peer> Members::get_suspected_peers() const {
   return members_->get_suspected_peers();
 }
 
+std::shared_ptr<const MembersSnapshot> Members::snapshot() const {
+  return std::atomic_load(&snapshot_);
+}
+
+const MembersMetrics &Members::metrics() const {
+  return metrics_;
+}
+
+bool Members::publish() {
+  auto version = members_->version();
+  if (version==std::atomic_load(&snapshot_)->version) {
+    return false;
+  }
+  // The last reader of the spare released it with a decrement that the fence pairs
+  // with, its reads are done before we write over the vectors
+  if (spare_==nullptr || spare_.use_count()!=1) {
+    spare_ = std::make_shared<MembersSnapshot>();
+  }
+  std::atomic_thread_fence(std::memory_order_acquire);
+  spare_->version = version;
+  members_->get_alive_peers(spare_->alive);
+  members_->get_suspected_peers(spare_->suspects);
+  auto previous = std::atomic_exchange(&snapshot_, std::shared_ptr<const MembersSnapshot>(spare_));
+  spare_ = std::const_pointer_cast<MembersSnapshot>(previous);
+  return true;
+}
+
 void Members::add_peer(Peer &peer) {
-  peer.update_timestamp(tround_);
+  peer.update_timestamp(now_() + std::chrono::milliseconds(tround_));
   members_->add_peer(peer);
+  arm(peer.get_handle());
 }
 
 bool Members::is_dead(const std::string &id) const {
-  return members_->is_dead(id);
+  return members_->is_dead(members_->handle(id));
 }
 
 bool Members::is_alive(const std::string &id) const {
-  return members_->is_alive(id);
+  return members_->is_alive(members_->handle(id));
+}
+
+peer_handle Members::handle(std::string_view id) const {
+  return members_->handle(id);
+}
+
+bool Members::is_alive(peer_handle h) const {
+  return members_->is_alive(h);
 }
+
+bool Members::is_dead(peer_handle h) const {
+  return members_->is_dead(h);
+}
+
 void Members::set_me(std::string_view t_me) {
-  me_ = t_me;
+  me_ = members_->intern(std::string(t_me));
 }
 
 std::string_view Members::get_me() {
-  return me_;
+  return me_==no_handle ? std::string_view{} : members_->name(me_);
+}
+
+void Members::beat() {
+  members_->inc_heartbeat(me_, Trace{trace_now_(), 0});
 }
 void Members::to_suspected(const std::string &id) {
-  members_->to_suspected(id);
+  members_->to_suspected(members_->handle(id));
 }
 
 std::shared_ptr<Peer> Members::get_peer(const std::string &id) {
-  return members_->get_peer(id);
+  return members_->get_peer(members_->handle(id));
 }
 
 int Members::get_tround() const {
@@ -342,5 +923,58 @@ void Members::set_tround(int Tround) {
   tround_ = Tround;
 }
 
+RoundRobin::RoundRobin() : gen_(std::random_device{}()) {}
+
+void RoundRobin::next(const Members &members, unsigned int k, std::vector<Peer> &out) {
+  std::size_t n = 0;
+  bool refilled = false;
+  while (n < k) {
+    if (pos_==order_.size()) {
+      // A second refill in one call means every alive peer was already looked at
+      if (refilled) {
+        break;
+      }
+      members.get_alive_handles(order_);
+      // Peers already picked by this call at the end of the last pass go to the back,
+      // skipping them at the front would cost them their turn in the new pass
+      auto fresh = std::partition(order_.begin(), order_.end(), [&](peer_handle h) {
+        return std::none_of(out.begin(), out.begin() + n, [h](const Peer &p) { return p.get_handle()==h; });
+      });
+      std::shuffle(order_.begin(), fresh, gen_);
+      pos_ = 0;
+      refilled = true;
+      if (order_.empty()) {
+        break;
+      }
+    }
+    auto h = order_[pos_++];
+    auto[peer, alive] = members.find(h);
+    if (!alive || std::any_of(out.begin(), out.begin() + n, [h](const Peer &p) { return p.get_handle()==h; })) {
+      continue;
+    }
+    if (n < out.size()) {
+      out[n] = *peer;
+    } else {
+      out.push_back(*peer);
+    }
+    ++n;
+  }
+  out.erase(out.begin() + n, out.end());
+}
+
+DeltaSync::DeltaSync(unsigned int full_sync_rounds, unsigned int window)
+    : full_sync_rounds_(std::max(full_sync_rounds, 1u)),
+      window_(std::max(window, 1u), 0) {}
+
+bool DeltaSync::begin_round(const Members &members) {
+  window_[rounds_%window_.size()] = members.version();
+  return rounds_++%full_sync_rounds_==0;
+}
+
+void DeltaSync::next(const Members &members, std::vector<Peer> &out) {
+  // The oldest slot holds the version from window rounds ago
+  members.get_alive_peers_since(window_[rounds_%window_.size()], out);
+}
+
 } // namespace gossip
 
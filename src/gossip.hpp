@@ -1,9 +1,18 @@
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <limits>
 #include <map>
 #include <mutex>
 #include <memory>
+#include <shared_mutex>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <unordered_map>
 #include <chrono>
 #include <utility>
@@ -11,147 +20,98 @@
 
 #include <msgpack.hpp>
 #include <queue>
-#include <ConcurentQueue.hpp>
+#include <random>
 #include <iostream>
 
-#include "SimpleTimer.hpp"
+#include "TimerWheel.hpp"
+#include "Metrics.hpp"
 
 namespace gossip {
 
-class ConcTimerMgr {
-public:
-  ConcTimerMgr() = default;
-  ~ConcTimerMgr() {
-    for (auto &tm:m_timers) {
-      tm.second->cancel();
-    }
-    for (auto &t : m_threads) {
-      if (t.second.joinable()) {
-        t.second.join();
-      }
-    }
-  }
-
-  void start() {
-    is_running = true;
-    m_mgr_thread = std::thread(&ConcTimerMgr::process, this);
-  }
-
-  void stop() {
-    is_running = false;
-    m_tasks.push(Task{"", Operation::stop});
-  }
-
-  void cancel(const std::string &id) {
-    m_tasks.push(Task{id, Operation::cancel});
-  }
+using peer_handle = std::uint32_t;
+constexpr peer_handle no_handle = std::numeric_limits<peer_handle>::max();
 
-  void create(const std::string &id, int time, std::function<void()> fn) {
-    m_tasks.push(Task{id, fn, time, Operation::create});
-  }
+// Maps peer ids and addresses to dense integer handles on first sight. Handles are
+// never reused and the string behind a handle lives as long as the Interner.
+class Interner {
+public:
+  peer_handle intern(std::string_view s);
+  // Returns no_handle for a string that was never interned.
+  peer_handle find(std::string_view s) const;
+  const std::string &get(peer_handle h) const;
+  std::size_t size() const;
 
 private:
-  std::thread m_mgr_thread;
-  enum class Operation {
-    create,
-    cancel,
-    stop
-  };
-
-  struct Task {
-    Task(const std::string &t_id, std::function<void()> &t_fn, int t_time, Operation t_op) : id(t_id),
-                                                                                             fn(std::move(t_fn)),
-                                                                                             time(t_time),
-                                                                                             op(t_op) {};
-
-    Task(const std::string &t_id, enum Operation t_op) : id(t_id), fn(), time(), op(t_op) {
-
-    }
-    std::string id;
-    std::function<void()> fn;
-    int time;
-    Operation op;
-  };
-
-  //std::queue<std::string> m_threads_done;
-  container::ConcurrentQueue<Task> m_tasks;
-  std::unordered_map<std::string, std::thread> m_threads;
-  std::unordered_map<std::string, std::shared_ptr<timer::SimpleTimer>> m_timers;
-  std::atomic<bool> is_running{false};
-
-  void process() {
-    while (is_running.load()) {
-      auto t = m_tasks.pop();
-      switch (t.op) {
-      case Operation::create:create_timed_task(t.id, t.time, t.fn);
-        break;
-      case Operation::cancel:cancel_timed_task(t.id);
-        break;
-      case Operation::stop:is_running.store(false);
-        break;
-      }
-    }
-  }
+  std::unordered_map<std::string_view, peer_handle> handles_;
+  std::deque<std::string> strings_;
+  mutable std::shared_mutex mutex_;
+};
 
-  void create_timed_task(const std::string &id, int time, const std::function<void()> &fn) {
-    auto timer(std::make_shared<timer::SimpleTimer>());
-    auto[t_it, okt] = m_timers.emplace(id, timer);
-    if (!okt) {
-      t_it->second->cancel();
-      t_it->second = timer;
-    }
+// Dense array of the alive handles with swap-remove and the position of each handle,
+// so membership changes are O(1) and sampling reads k entries without copying the table.
+class AliveIndex {
+public:
+  void insert(peer_handle h);
+  void erase(peer_handle h);
+  std::size_t size() const;
+  // Up to k distinct handles other than skip, drawn uniformly, written over out.
+  void sample(std::size_t k, peer_handle skip, std::mt19937 &gen, std::vector<peer_handle> &out) const;
+  void handles(std::vector<peer_handle> &out) const;
 
-    auto func = [&]() {
-      timer->start_sync(time, fn);
-    };
-
-    bool ok;
-    std::tie(std::ignore, ok) = m_threads.emplace(id, func);
-    if (!ok) {
-      auto &t = m_threads.at(id);
-      if (t.joinable()) {
-        t.join();
-      }
-      m_threads.erase(id);
-      m_threads.emplace(id, func);
-    }
-  }
+private:
+  static constexpr std::uint32_t none = std::numeric_limits<std::uint32_t>::max();
+  std::vector<peer_handle> handles_;
+  // Position in handles_ indexed by handle, none when not alive
+  std::vector<std::uint32_t> index_;
+  mutable std::mutex m_;
+};
 
-  void cancel_timed_task(const std::string &id) {
-    if (m_timers.find(id)!=m_timers.cend()) {
-      auto &tm = m_timers.at(id);
-      tm->cancel();
-      auto &t = m_threads.at(id);
-      if (t.joinable()) {
-        t.join();
-      }
-      m_threads.erase(id);
-      m_timers.erase(id);
-    }
-  }
+// Where the current heartbeat of a peer comes from, for convergence tracing: when its
+// node incremented it, in microseconds of that node's wall clock, and the gossip hops
+// it took since. origin 0 is an untraced heartbeat.
+struct Trace {
+  std::uint64_t origin{0};
+  std::uint32_t hops{0};
 };
 
+// Heartbeat and deadline are atomics so reads, monotonic updates and copies never lock.
 class Peer {
 private:
   std::string id_;
   std::string address_;
-  std::chrono::time_point<std::chrono::steady_clock> m_timestamp_;
-  unsigned int heartbeat_ = 1;
-  mutable std::mutex g_i_mutex;
+  std::atomic<std::chrono::steady_clock::rep> m_timestamp_{0};
+  std::atomic<unsigned int> heartbeat_{1};
+  // Trace of heartbeat_, stored after it so a racing copy may pair a new heartbeat
+  // with the previous trace
+  std::atomic<std::uint64_t> trace_origin_{0};
+  std::atomic<std::uint32_t> trace_hops_{0};
+  // Local only, set when the peer enters a MembersTable and never sent on the wire.
+  peer_handle handle_{no_handle};
+  peer_handle address_handle_{no_handle};
 
 public:
   Peer(std::string id, std::string address);
   Peer() = default;
   ~Peer() = default;
   Peer(Peer const &other);
+  Peer(Peer &&other) noexcept;
   Peer &operator=(Peer const &other);
+  Peer &operator=(Peer &&other) noexcept;
 
-  std::string get_id() const;
-  std::string get_address() const;
+  const std::string &get_id() const;
+  const std::string &get_address() const;
+  peer_handle get_handle() const;
+  peer_handle get_address_handle() const;
+  void set_handles(peer_handle id, peer_handle address);
   unsigned int get_heartbeat() const;
   void heartbeat(unsigned int i);
   void inc_heartbeat();
   void update_timestamp(int tround);
+  void update_timestamp(std::chrono::steady_clock::time_point ts);
+  // Applies i and sets the timestamp to ts only if i is newer, returns true when applied.
+  bool update_heartbeat(unsigned int i, std::chrono::steady_clock::time_point ts);
+  Trace get_trace() const;
+  void set_trace(const Trace &trace);
 
   std::chrono::time_point<std::chrono::steady_clock> get_timestamp() const;
   friend bool operator>(const Peer &lhs, const Peer &rhs);
@@ -161,7 +121,32 @@ public:
   //friend void swap(Peer &lhs, Peer &rhs);
 
   friend std::ostream &operator<<(std::ostream &, const Peer &);
-  MSGPACK_DEFINE (id_, address_, heartbeat_)
+
+  // Same wire format as MSGPACK_DEFINE(id_, address_, heartbeat_), written out
+  // because msgpack has no adaptor for std::atomic.
+  template<typename Packer>
+  void msgpack_pack(Packer &pk) const {
+    pk.pack_array(3);
+    pk.pack(id_);
+    pk.pack(address_);
+    pk.pack(heartbeat_.load(std::memory_order_relaxed));
+  }
+
+  void msgpack_unpack(msgpack::object const &o) {
+    if (o.type!=msgpack::type::ARRAY) {
+      throw msgpack::type_error();
+    }
+    const auto size = o.via.array.size;
+    if (size > 0) {
+      o.via.array.ptr[0].convert(id_);
+    }
+    if (size > 1) {
+      o.via.array.ptr[1].convert(address_);
+    }
+    if (size > 2) {
+      heartbeat_.store(o.via.array.ptr[2].as<unsigned int>(), std::memory_order_relaxed);
+    }
+  }
 
   template <typename Writer>
   void Serialize(Writer& writer) const {
@@ -173,32 +158,200 @@ public:
     writer.String(address_.c_str());
 
     writer.String("heartbeat");
-    writer.Uint(heartbeat_);
+    writer.Uint(heartbeat_.load(std::memory_order_relaxed));
     writer.EndObject();
   }
 };
 
+enum class PeerState {
+  alive,
+  suspect
+};
+
+// Peers are keyed by their interned id and partitioned over SHARDS shards, each with
+// its own lock, so writers on different peers do not contend. Snapshots lock one
+// shard at a time. Every peer is stored once with its state, state changes are a
+// single lookup.
 class MembersTable {
 public:
+  static constexpr std::size_t SHARDS = 16;
+
+  enum class Heartbeat {
+    added,
+    updated,
+    revived,
+    stale
+  };
+
   MembersTable();
-  bool is_alive(const std::string &id) const;
-  bool is_dead(const std::string &id) const;
+  peer_handle intern(std::string_view id);
+  // Returns no_handle for an id that was never seen.
+  peer_handle handle(std::string_view id) const;
+  const std::string &name(peer_handle h) const;
+  bool is_alive(peer_handle h) const;
+  bool is_dead(peer_handle h) const;
   void add_peer(Peer &peer);
-  std::shared_ptr<Peer> get_peer(const std::string &id);
-  std::shared_ptr<Peer> get_suspect(const std::string &id);
+  std::shared_ptr<Peer> get_peer(peer_handle h);
+  std::shared_ptr<Peer> get_suspect(peer_handle h);
+  // Single lookup, returns the peer (nullptr when unknown) and if it is alive.
+  std::pair<std::shared_ptr<Peer>, bool> find(peer_handle h) const;
+  // Adds an unknown peer or applies a newer heartbeat, a suspect is moved back to alive.
+  // The peer gets timestamp when the heartbeat is new, handle is set to its handle.
+  Heartbeat heartbeat(Peer &peer, std::chrono::steady_clock::time_point timestamp, peer_handle *handle = nullptr);
+  // Same, straight from decoded fields. A Peer is only built for an unknown id.
+  // The peer keeps trace along with a new heartbeat.
+  Heartbeat heartbeat(std::string_view id, std::string_view address, unsigned int heartbeat,
+                      std::chrono::steady_clock::time_point timestamp, peer_handle *handle = nullptr,
+                      const Trace &trace = {});
+  // Increments the heartbeat of a peer we own (ourselves) and marks it changed.
+  void inc_heartbeat(peer_handle h, const Trace &trace = {});
+  // Moves h from state from to state to, returns the peer or nullptr if h was not in from.
+  std::shared_ptr<Peer> transition(peer_handle h, PeerState from, PeerState to);
   std::vector<Peer> get_alive_peers() const;
+  // Overwrites out in place so a reused vector does not allocate once it holds every peer.
+  void get_alive_peers(std::vector<Peer> &out) const;
+  // Alive peers changed after version since, written over out in place. Returns the
+  // version to pass next time, entries changed during the scan may be sent twice, never missed.
+  std::uint64_t get_alive_peers_since(std::uint64_t since, std::vector<Peer> &out) const;
+  // Current table version, bumped by every heartbeat or state change.
+  std::uint64_t version() const;
   std::vector<Peer> get_suspected_peers() const;
+  void get_suspected_peers(std::vector<Peer> &out) const;
+  std::vector<peer_handle> handles(PeerState state) const;
+  void handles(PeerState state, std::vector<peer_handle> &out) const;
+  // Up to k distinct alive handles other than skip in O(k), written over out.
+  void sample(std::size_t k, peer_handle skip, std::mt19937 &gen, std::vector<peer_handle> &out) const;
   int size() const;
-  void to_alive(const std::string &id);
-  void to_suspected(const std::string &id);
+  void to_alive(peer_handle h);
+  void to_suspected(peer_handle h);
 
-  void cleanup(const std::string &id);
+  // Removes a suspected peer, returns it or nullptr if h was not suspected.
+  std::shared_ptr<Peer> cleanup(peer_handle h);
+
+private:
+  struct Entry {
+    std::shared_ptr<Peer> peer;
+    PeerState state;
+    // Table version of the last heartbeat or state change
+    std::uint64_t changed{0};
+  };
+  struct Shard {
+    std::unordered_map<peer_handle, Entry> peers_{};
+    mutable std::mutex m_members_mutex;
+  };
+  Interner ids_;
+  std::array<Shard, SHARDS> shards_{};
+  // Updated under the shard lock of the handle entering or leaving alive
+  AliveIndex alive_;
+  std::atomic<std::uint64_t> version_{0};
+
+  Shard &shard(peer_handle h);
+  const Shard &shard(peer_handle h) const;
+  void snapshot(PeerState state, std::uint64_t since, std::vector<Peer> &out) const;
+  std::uint64_t next_version();
+};
+
+// Decides when an alive peer is suspected. heartbeat is called concurrently from the
+// listener threads for every new heartbeat, deadline from the cleanup thread.
+class FailureDetector {
+public:
+  using clock = std::chrono::steady_clock;
+
+  virtual ~FailureDetector() = default;
+  // h was heard from at now.
+  virtual void heartbeat(peer_handle h, clock::time_point now) = 0;
+  // When h is to be suspected unless heard from again. timestamp is the peer timestamp,
+  // the last heartbeat plus one round.
+  virtual clock::time_point deadline(peer_handle h, clock::time_point timestamp) const = 0;
+  // h left the table.
+  virtual void remove(peer_handle h) = 0;
+};
+
+// Suspects a peer a fixed timeout after its timestamp.
+class FixedTimeout : public FailureDetector {
+public:
+  explicit FixedTimeout(std::chrono::milliseconds timeout);
+  void heartbeat(peer_handle h, clock::time_point now) override;
+  clock::time_point deadline(peer_handle h, clock::time_point timestamp) const override;
+  void remove(peer_handle h) override;
+
+private:
+  std::chrono::milliseconds timeout_;
+};
+
+// Phi accrual detector (Hayashibara et al.). Keeps the last WINDOW heartbeat
+// inter-arrival times of every peer and suspects it once
+// phi = -log10(P(no heartbeat for that long)) reaches threshold, with the intervals
+// taken as normally distributed. A steady peer is suspected soon after it goes quiet,
+// a jittery one gets a proportionally longer deadline.
+class PhiAccrual : public FailureDetector {
+public:
+  static constexpr std::size_t WINDOW = 64;
+
+  // min_std keeps very regular peers from being suspected on the first late heartbeat,
+  // pause is added to every deadline and first_interval seeds the history of a new
+  // peer, usually the gossip round.
+  PhiAccrual(double threshold, std::chrono::milliseconds min_std, std::chrono::milliseconds pause,
+             std::chrono::milliseconds first_interval);
+  void heartbeat(peer_handle h, clock::time_point now) override;
+  clock::time_point deadline(peer_handle h, clock::time_point timestamp) const override;
+  void remove(peer_handle h) override;
+  // Suspicion level of h at now, 0 for a peer never heard from.
+  double phi(peer_handle h, clock::time_point now) const;
 
 private:
-  std::unordered_map<std::string, std::shared_ptr<Peer>> alive_{};
-  std::unordered_map<std::string, std::shared_ptr<Peer>> dead_{};
+  // Ring of inter-arrival times in ms with running sums for the mean and variance
+  struct History {
+    clock::time_point last;
+    std::array<double, WINDOW> intervals{};
+    std::size_t next{0};
+    std::size_t count{0};
+    double sum{0};
+    double squares{0};
+
+    void add(double interval);
+    double mean() const;
+    double std_dev(double min_std) const;
+  };
+  struct Shard {
+    std::unordered_map<peer_handle, History> peers_;
+    mutable std::mutex mutex_;
+  };
+
+  double threshold_;
+  double min_std_;
+  double pause_;
+  double first_interval_;
+  // Standardized delay where phi reaches threshold
+  double y_;
+  std::array<Shard, 16> shards_{};
+
+  static double phi(double y);
+};
+
+// Events of the failure detection path, counted by Members and read by the metrics
+// registry. Recoveries are suspects heard from again or refuting their suspicion.
+// Traced heartbeats applied are observed in dissemination_delay, the time since their
+// origin incremented them, and dissemination_hops.
+struct MembersMetrics {
+  MembersMetrics();
+
+  Counter heartbeats_applied;
+  Counter heartbeats_stale;
+  Counter suspicions;
+  Counter removals;
+  Counter recoveries;
+  Histogram cleanup_duration;
+  Histogram dissemination_delay;
+  Histogram dissemination_hops;
+};
 
-  mutable std::mutex m_members_mutex;
+// Copy of the table at version, never modified once published so readers share it
+// without locking.
+struct MembersSnapshot {
+  std::uint64_t version{0};
+  std::vector<Peer> alive;
+  std::vector<Peer> suspects;
 };
 
 class Members {
@@ -207,24 +360,83 @@ private:
 
   std::unique_ptr<std::thread> t_;
   std::unique_ptr<MembersTable> members_ = std::make_unique<MembersTable>();
-  std::string_view me_;
+  peer_handle me_{no_handle};
 
-  int tfail_ = 150;
-  int tcleanup_ = tfail_*2;
+  int tcleanup_ = 300;
   int tround_ = 150;
+  std::unique_ptr<FailureDetector> detector_ = std::make_unique<FixedTimeout>(std::chrono::milliseconds(150));
+  std::function<FailureDetector::clock::time_point()> now_ = &FailureDetector::clock::now;
+  std::function<std::uint64_t()> trace_now_;
+  // One timer per peer, the failure deadline while alive and the removal deadline
+  // while suspected. Heartbeats only move the peer timestamp, an expired timer
+  // re-checks it and is armed again when the peer was heard from in the meantime.
+  // cleanup_task runs when the next deadline is due, from the cleanup thread or the
+  // timer of a wakeup, the tick only bounds how late a timer fires. 8192 slots cover
+  // 8 s of deadlines per turn.
+  timer::TimerWheel timers_{std::chrono::milliseconds(1), 8192};
+  std::function<void(FailureDetector::clock::time_point)> wakeup_;
+  // Keeps the last wakeup call the one with the earliest deadline
+  std::mutex wakeup_mutex_;
+  // Published with atomic_store, the previous one is kept to be refilled by the next
+  // publish once no reader holds it
+  std::shared_ptr<const MembersSnapshot> snapshot_ = std::make_shared<MembersSnapshot>();
+  std::shared_ptr<MembersSnapshot> spare_;
+  MembersMetrics metrics_;
+
+  void arm(peer_handle h);
+  void expire(peer_handle h);
+  void wake();
+  FailureDetector::clock::time_point due(const Peer &peer, peer_handle h, bool alive) const;
 public:
   Members();
   ~Members();
 
   void heartbeat(Peer &peer);
+  // A traced heartbeat is kept with one more hop and observed in metrics when applied.
+  void heartbeat(std::string_view id, std::string_view address, unsigned int heartbeat, const Trace &trace = {});
   void add_peer(Peer &peer);
   std::vector<Peer> get_alive_peers() const;
+  void get_alive_peers(std::vector<Peer> &out) const;
+  std::uint64_t get_alive_peers_since(std::uint64_t since, std::vector<Peer> &out) const;
+  std::uint64_t version() const;
   std::vector<Peer> get_suspected_peers() const;
+  // Last published snapshot, never null. Takes no membership lock.
+  std::shared_ptr<const MembersSnapshot> snapshot() const;
+  // Copies the table into a new snapshot and swaps it in when it changed since the
+  // last one, returns true when it did. Called from a single thread, once per round
+  // or so, readers of snapshot never wait for it.
+  bool publish();
+  const MembersMetrics &metrics() const;
   std::vector<Peer> get_random_peers(unsigned int k) const;
+  // Up to k distinct alive peers other than me, written over out in place. O(k), the
+  // table is not copied and nothing is allocated once out is warm.
+  void get_random_peers(unsigned int k, std::vector<Peer> &out) const;
+  // Alive handles other than me, written over out.
+  void get_alive_handles(std::vector<peer_handle> &out) const;
+  // Single lookup, returns the peer (nullptr when unknown) and if it is alive.
+  std::pair<std::shared_ptr<Peer>, bool> find(peer_handle h) const;
   void deadline(const std::string &id);
   void cleanup(const std::string &id);
+  void deadline(peer_handle h);
+  void cleanup(peer_handle h);
+  // Moves a suspect back to alive, for a peer that refuted its suspicion.
+  void refute(peer_handle h);
+  // Suspects peers t ms after their timestamp, replacing the failure detector with a
+  // FixedTimeout. Set before start_cleanup.
   void set_tfail(int t);
   void set_tclean(int t);
+  void set_detector(std::unique_ptr<FailureDetector> detector);
+  // Time source for heartbeats and deadlines, tests drive it by hand together with
+  // cleanup_task. Set before any peer is added, the timer wheel starts at its now.
+  void set_clock(std::function<FailureDetector::clock::time_point()> now);
+  // Wall clock in microseconds our heartbeats are traced with, and traced heartbeats
+  // of others measured against. Delays measured across nodes include the offset
+  // between their clocks.
+  void set_trace_clock(std::function<std::uint64_t()> now);
+  // Runs cleanup_task from a timer of the caller instead of the cleanup thread: wakeup
+  // gets the next deadline now, after every cleanup_task and whenever an earlier timer
+  // is armed, the latter from the thread of the heartbeat.
+  void set_wakeup(std::function<void(FailureDetector::clock::time_point)> wakeup);
   int get_tround() const;
   void set_tround(int Tround);
   int size() const;
@@ -234,9 +446,50 @@ public:
   void stop_cleanup();
   bool is_alive(const std::string &id) const;
   bool is_dead(const std::string &id) const;
+  // Returns no_handle for an id that was never seen.
+  peer_handle handle(std::string_view id) const;
+  bool is_alive(peer_handle h) const;
+  bool is_dead(peer_handle h) const;
   void set_me(std::string_view t_me);
   std::string_view get_me();
+  // Increments our own heartbeat, once per gossip round.
+  void beat();
   void to_suspected(const std::string &id);
   std::shared_ptr<Peer> get_peer(const std::string &id);
 };
+
+// Hands out alive peers in a shuffled order, each one once per pass, so with k targets
+// per round every peer is contacted within ceil(N/k) rounds. Members that joined
+// during a pass are picked up by the next one, the order is reshuffled every pass.
+class RoundRobin {
+public:
+  RoundRobin();
+  // Writes the next up to k distinct alive peers other than me over out.
+  void next(const Members &members, unsigned int k, std::vector<Peer> &out);
+
+private:
+  std::vector<peer_handle> order_;
+  std::size_t pos_{0};
+  std::mt19937 gen_;
+};
+
+// Picks what a gossip round sends. Most rounds carry the alive entries changed in the
+// last window rounds, so a change reaches every target of window rounds and a lost
+// delta is repaired by the next ones. Every full_sync_rounds-th round sends the full
+// alive table, which brings new nodes up to date. full_sync_rounds of 1 sends the full
+// table every round.
+class DeltaSync {
+public:
+  explicit DeltaSync(unsigned int full_sync_rounds = 1, unsigned int window = 4);
+  // Starts a round, returns true when it should send the full table.
+  bool begin_round(const Members &members);
+  // Writes the delta of the current round over out, the same for every target.
+  void next(const Members &members, std::vector<Peer> &out);
+
+private:
+  unsigned int full_sync_rounds_;
+  unsigned int rounds_{0};
+  // Table version at the start of each of the last window rounds
+  std::vector<std::uint64_t> window_;
+};
 } // namespace gossip
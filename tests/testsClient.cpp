@@ -1,6 +1,7 @@
 #include <catch2/catch.hpp>
 #include <Client.hpp>
 #include <Listener.hpp>
+#include <unistd.h>
 
 TEST_CASE("Send a peer message to listener", "[client]"){
   std::atomic<bool> started{false};
@@ -45,3 +46,425 @@ TEST_CASE("Send a peer message to listener", "[client]"){
   REQUIRE(peers == actual);
 }
 
+TEST_CASE("Send a peer message to several listeners in one batch", "[client]") {
+  std::atomic<int> started{0};
+  std::vector<std::vector<gossip::Peer>> actual(2);
+
+  auto receive = [&](const std::string &port, std::vector<gossip::Peer> &out) {
+    gossip::Listener server;
+    auto sockfd = server.create_connection("127.0.0.1", port);
+    char buf[1024];
+    ++started;
+    auto s = server.listen_gossip(sockfd, buf, 1024, 0);
+    out = server.deserialize(buf, s);
+    ::close(sockfd);
+  };
+  std::thread l1(receive, "5002", std::ref(actual[0]));
+  std::thread l2(receive, "5003", std::ref(actual[1]));
+
+  gossip::Client client{};
+  std::vector<gossip::Peer> peers{gossip::Peer{"123", "127.0.0.1:5000"}, gossip::Peer{"456", "127.0.0.1:5004"}};
+
+  msgpack::sbuffer ss;
+  auto s = client.serialize(ss, peers);
+  while (started.load() < 2) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  }
+  auto r = client.send_members(ss.data(), s, {"127.0.0.1:5002", "127.0.0.1:5003"});
+  REQUIRE(r==2);
+
+  l1.join();
+  l2.join();
+  REQUIRE(peers==actual[0]);
+  REQUIRE(peers==actual[1]);
+}
+
+TEST_CASE("Resolved addresses are cached", "[client]") {
+  gossip::Client client{};
+  auto a = client.resolve("127.0.0.1:5000");
+  REQUIRE(a!=nullptr);
+  REQUIRE(ntohs(a->sin_port)==5000);
+  REQUIRE(client.resolve("127.0.0.1:5000")==a);
+  REQUIRE(client.resolve("not-an-address")==nullptr);
+}
+
+TEST_CASE("Receive several messages with one batch", "[listener]") {
+  gossip::Listener server{8, 1024};
+  auto sockfd = server.create_connection("127.0.0.1", "5005", 1 << 20);
+
+  gossip::Client client{};
+  std::vector<gossip::Peer> peers{gossip::Peer{"123", "127.0.0.1:5000"}};
+  msgpack::sbuffer ss;
+  auto s = client.serialize(ss, peers);
+  REQUIRE(client.send_members(ss.data(), s, {"127.0.0.1:5005", "127.0.0.1:5005", "127.0.0.1:5005"})==3);
+
+  std::vector<std::vector<gossip::Peer>> actual;
+  while (actual.size() < 3) {
+    server.listen_gossip_batch(sockfd, [&](const char *buf, std::size_t len) {
+      actual.push_back(server.deserialize(buf, len));
+    });
+  }
+  ::close(sockfd);
+  REQUIRE(server.received()==3);
+  REQUIRE(server.truncated()==0);
+  for (const auto &a : actual) {
+    REQUIRE(a==peers);
+  }
+}
+
+TEST_CASE("Truncated messages are counted and skipped", "[listener]") {
+  gossip::Listener server{4, 16};
+  auto sockfd = server.create_connection("127.0.0.1", "5006");
+
+  gossip::Client client{};
+  std::string big(64, 'x');
+  REQUIRE(client.send_members(big.data(), big.size(), "127.0.0.1", "5006")==0);
+
+  int delivered = 0;
+  auto n = server.listen_gossip_batch(sockfd, [&](const char *, std::size_t) { ++delivered; });
+  ::close(sockfd);
+  REQUIRE(n==1);
+  REQUIRE(delivered==0);
+  REQUIRE(server.truncated()==1);
+}
+
+TEST_CASE("Listener pool shares one port between workers", "[listener]") {
+  std::atomic<int> handled{0};
+  gossip::ListenerPool pool{4, 8, 1024};
+  pool.start("127.0.0.1", "5007", 1 << 20, [&](const char *buf, std::size_t len) {
+    auto peers = gossip::Listener::deserialize(buf, len);
+    handled += static_cast<int>(peers.size());
+  });
+  REQUIRE(pool.size()==4);
+
+  std::vector<gossip::Peer> peers{gossip::Peer{"123", "127.0.0.1:5000"}};
+  std::vector<std::thread> senders;
+  for (int i = 0; i < 4; ++i) {
+    senders.emplace_back([&] {
+      gossip::Client client{};
+      msgpack::sbuffer ss;
+      auto s = client.serialize(ss, peers);
+      client.send_members(ss.data(), s, std::vector<std::string>(10, "127.0.0.1:5007"));
+    });
+  }
+  for (auto &t : senders) {
+    t.join();
+  }
+
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+  while (handled.load() < 40 && std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  pool.stop();
+  REQUIRE(handled.load()==40);
+  REQUIRE(pool.received()==40);
+}
+
+TEST_CASE("Send to peers resolved by address handle", "[client]") {
+  std::atomic<int> received{0};
+  auto receive = [&](const std::string &port) {
+    gossip::Listener server;
+    auto sockfd = server.create_connection("127.0.0.1", port);
+    char buf[1024];
+    if (server.listen_gossip(sockfd, buf, 1024, 0) > 0) {
+      ++received;
+    }
+    ::close(sockfd);
+  };
+  std::thread l1(receive, "5008");
+  std::thread l2(receive, "5009");
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+  gossip::Members members{};
+  gossip::Peer p1{"123", "127.0.0.1:5008"};
+  gossip::Peer p2{"456", "127.0.0.1:5009"};
+  members.add_peer(p1);
+  members.add_peer(p2);
+  auto table = members.get_alive_peers();
+
+  gossip::Client client{};
+  const char msg[] = "table";
+  REQUIRE(client.send_to_peers(msg, sizeof(msg), table)==2);
+  REQUIRE(client.resolve(table[0])==client.resolve(table[0]));
+
+  l1.join();
+  l2.join();
+  REQUIRE(received.load()==2);
+}
+
+TEST_CASE("Tables larger than a datagram are split", "[client]") {
+  std::vector<gossip::Peer> peers;
+  for (int i = 0; i < 200; ++i) {
+    peers.emplace_back("node-" + std::to_string(i) + ".gspd.cluster.local", "127.0.0.1:5000");
+  }
+  gossip::Client client{};
+  msgpack::sbuffer sbuf;
+  std::size_t first = 0;
+  std::size_t decoded = 0;
+  int datagrams = 0;
+  while (first < peers.size()) {
+    sbuf.clear();
+    first = client.serialize(sbuf, peers, first, 512);
+    REQUIRE(sbuf.size() <= 512);
+    decoded += gossip::Listener::deserialize(sbuf.data(), sbuf.size()).size();
+    ++datagrams;
+  }
+  REQUIRE(datagrams > 1);
+  REQUIRE(decoded==peers.size());
+}
+
+TEST_CASE("A 10k peer table is split into independently decodable chunks", "[client]") {
+  std::vector<gossip::Peer> peers;
+  for (int i = 0; i < 10000; ++i) {
+    peers.emplace_back("node-" + std::to_string(i) + ".gspd.cluster.local", "10.0." + std::to_string(i/256) + "." + std::to_string(i%256) + ":5000");
+    peers.back().heartbeat(i*1000);
+  }
+  gossip::Client client{};
+  msgpack::sbuffer sbuf;
+  std::vector<gossip::Peer> decoded;
+  std::size_t first = 0;
+  while (first < peers.size()) {
+    sbuf.clear();
+    first = client.serialize(sbuf, peers, first, 1400);
+    REQUIRE(sbuf.size() <= 1400);
+    auto chunk = gossip::Listener::deserialize(sbuf.data(), sbuf.size());
+    REQUIRE_FALSE(chunk.empty());
+    decoded.insert(decoded.end(), chunk.begin(), chunk.end());
+  }
+  REQUIRE(decoded.size()==peers.size());
+  for (std::size_t i = 0; i < peers.size(); ++i) {
+    REQUIRE(decoded[i].get_id()==peers[i].get_id());
+    REQUIRE(decoded[i].get_address()==peers[i].get_address());
+    REQUIRE(decoded[i].get_heartbeat()==peers[i].get_heartbeat());
+  }
+}
+
+TEST_CASE("A 10k peer table sent in chunks reaches the members table", "[client]") {
+  gossip::Members members{};
+  gossip::Listener server{64, 1400};
+  auto sockfd = server.create_connection("127.0.0.1", "5011", 8 << 20);
+
+  std::vector<gossip::Peer> table;
+  for (int i = 0; i < 10000; ++i) {
+    table.emplace_back("node-" + std::to_string(i) + ".gspd.cluster.local", "127.0.0.1:5000");
+  }
+  std::vector<gossip::Peer> target{gossip::Peer{"sink", "127.0.0.1:5011"}};
+  gossip::Client client{};
+  msgpack::sbuffer sbuf;
+  auto datagrams = client.send_table(sbuf, table, target, 1400);
+  REQUIRE(datagrams > 1);
+
+  std::uint64_t received = 0;
+  while (received + server.dropped() < static_cast<std::uint64_t>(datagrams)) {
+    received += server.listen_gossip_batch(sockfd, [&](const char *buf, std::size_t len) {
+      for (auto &p : gossip::Listener::deserialize(buf, len)) {
+        members.heartbeat(p);
+      }
+    });
+  }
+  ::close(sockfd);
+  REQUIRE(server.truncated()==0);
+  REQUIRE(received + server.dropped()==static_cast<std::uint64_t>(datagrams));
+  // The kernel may cap SO_RCVBUF below what one 10k burst needs, only a lossless run sees every peer
+  if (server.dropped()==0) {
+    REQUIRE(members.size()==10000);
+  }
+}
+
+TEST_CASE("Decode hands out peers without building them", "[client]") {
+  std::vector<gossip::Peer> peers;
+  for (int i = 0; i < 100; ++i) {
+    peers.emplace_back("node-" + std::to_string(i) + ".gspd.cluster.local", "127.0.0.1:" + std::to_string(5000 + i));
+    peers.back().heartbeat(i*100000);
+  }
+  gossip::Client client{};
+  msgpack::sbuffer sbuf;
+  client.serialize(sbuf, peers);
+
+  std::size_t i = 0;
+  auto n = gossip::Listener::decode(sbuf.data(), sbuf.size(),
+                                    [&](std::string_view id, std::string_view address, unsigned int hb) {
+                                      REQUIRE(id==peers[i].get_id());
+                                      REQUIRE(address==peers[i].get_address());
+                                      REQUIRE(hb==peers[i].get_heartbeat());
+                                      ++i;
+                                    });
+  REQUIRE(n==peers.size());
+  REQUIRE(i==peers.size());
+
+  auto ignore = [](std::string_view, std::string_view, unsigned int) {};
+  REQUIRE_THROWS(gossip::Listener::decode(sbuf.data(), sbuf.size()/2, ignore));
+  const char garbage[] = {'\xc1', '\x00'};
+  REQUIRE_THROWS(gossip::Listener::decode(garbage, sizeof(garbage), ignore));
+  const char scalar[] = {'\x91', '\x01'};
+  REQUIRE_THROWS(gossip::Listener::decode(scalar, sizeof(scalar), ignore));
+  // Values of a type the table never holds are rejected, not skipped
+  const char float32[] = {'\x91', '\x93', '\xa1', 'a', '\xa1', 'b', '\xca', '\x3f', '\xc0', '\x00', '\x00'};
+  REQUIRE_THROWS(gossip::Listener::decode(float32, sizeof(float32), ignore));
+  const char float64[] = {'\x91', '\x93', '\xa1', 'a', '\xa1', 'b', '\xcb', '\x3f', '\xf8', '\x00', '\x00', '\x00',
+                          '\x00', '\x00', '\x00'};
+  REQUIRE_THROWS(gossip::Listener::decode(float64, sizeof(float64), ignore));
+  const char bin[] = {'\x91', '\x93', '\xc4', '\x01', 'a', '\xa1', 'b', '\x01'};
+  REQUIRE_THROWS(gossip::Listener::decode(bin, sizeof(bin), ignore));
+  const char ext[] = {'\x91', '\x93', '\xa1', 'a', '\xa1', 'b', '\xd4', '\x01', '\x00'};
+  REQUIRE_THROWS(gossip::Listener::decode(ext, sizeof(ext), ignore));
+  // A heartbeat past unsigned int is rejected instead of truncated
+  const char wide[] = {'\x91', '\x93', '\xa1', 'a', '\xa1', 'b', '\xcf', '\x00', '\x00', '\x00', '\x01', '\x00',
+                       '\x00', '\x00', '\x00'};
+  REQUIRE_THROWS(gossip::Listener::decode(wide, sizeof(wide), ignore));
+  const char widest[] = {'\x91', '\x93', '\xa1', 'a', '\xa1', 'b', '\xce', '\xff', '\xff', '\xff', '\xff'};
+  REQUIRE_NOTHROW(gossip::Listener::decode(widest, sizeof(widest), ignore));
+}
+
+TEST_CASE("Compact wire format round trips next to the legacy one", "[client][wire]") {
+  std::vector<gossip::Peer> peers{
+      gossip::Peer{"me", "10.0.0.1:5000"},
+      gossip::Peer{"v6", "[fe80::1]:5001"},
+      gossip::Peer{"host", "gspd-0.gspd:5002"},
+      gossip::Peer{"zeros", "010.0.0.1:05000"},
+  };
+  peers[0].heartbeat(1);
+  peers[1].heartbeat(300);
+  peers[2].heartbeat(4000000000u);
+
+  gossip::Client client{"me", 2};
+  msgpack::sbuffer sbuf;
+  client.serialize(sbuf, peers);
+  REQUIRE(gossip::wire::is_compact(sbuf.data(), sbuf.size()));
+
+  std::size_t i = 0;
+  auto n = gossip::Listener::decode(sbuf.data(), sbuf.size(),
+                                    [&](std::string_view id, std::string_view address, unsigned int hb) {
+                                      REQUIRE(id==peers[i].get_id());
+                                      REQUIRE(address==peers[i].get_address());
+                                      REQUIRE(hb==peers[i].get_heartbeat());
+                                      ++i;
+                                    });
+  REQUIRE(n==peers.size());
+  REQUIRE(gossip::Listener::deserialize(sbuf.data(), sbuf.size())==peers);
+
+  gossip::Client legacy{};
+  msgpack::sbuffer lbuf;
+  legacy.serialize(lbuf, peers);
+  REQUIRE_FALSE(gossip::wire::is_compact(lbuf.data(), lbuf.size()));
+  REQUIRE(sbuf.size() < lbuf.size());
+
+  auto ignore = [](std::string_view, std::string_view, unsigned int) {};
+  REQUIRE_THROWS_AS(gossip::wire::decode(sbuf.data(), sbuf.size() - 1, ignore), gossip::wire::wire_error);
+}
+
+TEST_CASE("Traced compact datagrams carry heartbeat origins", "[client][wire]") {
+  std::vector<gossip::Peer> peers{
+      gossip::Peer{"me", "10.0.0.1:5000"},
+      gossip::Peer{"other", "10.0.0.2:5000"},
+      gossip::Peer{"untraced", "10.0.0.3:5000"},
+  };
+  peers[0].set_trace({1790000000000000, 0});
+  peers[1].set_trace({1790000000123456, 4});
+
+  gossip::Client client{"me", 3};
+  msgpack::sbuffer sbuf;
+  client.serialize(sbuf, peers);
+  REQUIRE(gossip::wire::is_compact(sbuf.data(), sbuf.size()));
+
+  std::size_t i = 0;
+  gossip::Listener::decode(sbuf.data(), sbuf.size(),
+                           [&](std::string_view id, std::string_view, unsigned int, const gossip::Trace &trace) {
+                             REQUIRE(id==peers[i].get_id());
+                             REQUIRE(trace.origin==peers[i].get_trace().origin);
+                             REQUIRE(trace.hops==peers[i].get_trace().hops);
+                             ++i;
+                           });
+  REQUIRE(i==peers.size());
+  REQUIRE(gossip::Listener::deserialize(sbuf.data(), sbuf.size())[1].get_trace().hops==4);
+
+  // Callbacks without a trace read traced datagrams, untraced ones give empty traces
+  auto n = gossip::Listener::decode(sbuf.data(), sbuf.size(), [](std::string_view, std::string_view, unsigned int) {});
+  REQUIRE(n==peers.size());
+  gossip::Client untraced{"me", 2};
+  msgpack::sbuffer ubuf;
+  untraced.serialize(ubuf, peers);
+  REQUIRE(ubuf.size() < sbuf.size());
+  gossip::Listener::decode(ubuf.data(), ubuf.size(),
+                           [](std::string_view, std::string_view, unsigned int, const gossip::Trace &trace) {
+                             REQUIRE(trace.origin==0);
+                           });
+}
+
+TEST_CASE("A 10k peer table in the compact format", "[client][wire]") {
+  std::vector<gossip::Peer> peers;
+  for (int i = 0; i < 10000; ++i) {
+    peers.emplace_back("node-" + std::to_string(i) + ".gspd.cluster.local", "10.0." + std::to_string(i/256) + "." + std::to_string(i%256) + ":5000");
+    peers.back().heartbeat(i*1000);
+  }
+  gossip::Client client{"node-0.gspd.cluster.local", 2};
+  msgpack::sbuffer sbuf;
+  std::vector<gossip::Peer> decoded;
+  std::size_t first = 0;
+  while (first < peers.size()) {
+    sbuf.clear();
+    first = client.serialize(sbuf, peers, first, 1400);
+    REQUIRE(sbuf.size() <= 1400);
+    auto chunk = gossip::Listener::deserialize(sbuf.data(), sbuf.size());
+    REQUIRE_FALSE(chunk.empty());
+    decoded.insert(decoded.end(), chunk.begin(), chunk.end());
+  }
+  REQUIRE(decoded.size()==peers.size());
+  for (std::size_t i = 0; i < peers.size(); ++i) {
+    REQUIRE(decoded[i].get_id()==peers[i].get_id());
+    REQUIRE(decoded[i].get_address()==peers[i].get_address());
+    REQUIRE(decoded[i].get_heartbeat()==peers[i].get_heartbeat());
+  }
+}
+
+TEST_CASE("io_uring backend receives and sends batches", "[listener][uring]") {
+  if (!gossip::uring::available()) {
+    SUCCEED("built without liburing");
+    return;
+  }
+  gossip::Listener server{4, 64};
+  auto sockfd = server.create_connection("127.0.0.1", "5012", 1 << 20);
+  REQUIRE(server.use_io_uring(sockfd));
+  REQUIRE(server.poll_fd(sockfd)!=sockfd);
+
+  gossip::Client client{"123", 2};
+  REQUIRE(client.use_io_uring());
+  std::vector<gossip::Peer> peers{gossip::Peer{"123", "127.0.0.1:5000"}};
+  msgpack::sbuffer ss;
+  auto s = client.serialize(ss, peers);
+  REQUIRE(client.send_members(ss.data(), s, std::vector<std::string>(100, "127.0.0.1:5012"))==100);
+  std::string big(128, 'x');
+  REQUIRE(client.send_members(big.data(), big.size(), "127.0.0.1", "5012")==0);
+
+  std::vector<std::vector<gossip::Peer>> actual;
+  while (server.received() < 101) {
+    REQUIRE(server.listen_gossip_batch(sockfd, [&](const char *buf, std::size_t len) {
+      actual.push_back(gossip::Listener::deserialize(buf, len));
+    }) >= 0);
+  }
+  ::close(sockfd);
+  REQUIRE(actual.size()==100);
+  for (const auto &a : actual) {
+    REQUIRE(a==peers);
+  }
+  REQUIRE(server.truncated()==1);
+  REQUIRE(client.datagrams_sent()==101);
+}
+
+TEST_CASE("io_uring listener pool stops its workers", "[listener][uring]") {
+  std::atomic<int> handled{0};
+  gossip::ListenerPool pool{2, 8, 1024};
+  pool.use_io_uring();
+  pool.start("127.0.0.1", "5013", 1 << 20, [&](const char *, std::size_t) { ++handled; });
+
+  gossip::Client client{};
+  std::string msg(32, 'x');
+  client.send_members(msg.data(), msg.size(), std::vector<std::string>(10, "127.0.0.1:5013"));
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+  while (handled.load() < 10 && std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  auto got = handled.load();
+  pool.stop();
+  REQUIRE(got==10);
+}
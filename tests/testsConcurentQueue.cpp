@@ -1,4 +1,11 @@
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <memory>
+#include <thread>
+#include <vector>
 #include <catch2/catch.hpp>
+#include "BoundedQueue.hpp"
 #include "ConcurentQueue.hpp"
 
 TEST_CASE("Put and remove an element from the queue", "[ConcurrentQueue]") {
@@ -7,3 +14,108 @@ TEST_CASE("Put and remove an element from the queue", "[ConcurrentQueue]") {
   REQUIRE(q.pop() == 1);
 }
 
+
+TEMPLATE_TEST_CASE("Bounded queue applies backpressure", "[BoundedQueue]", container::mpmc, container::spsc) {
+  container::BoundedQueue<int, TestType> q{3};
+  REQUIRE(q.capacity()==4);
+
+  int item;
+  REQUIRE_FALSE(q.try_pop(item));
+  for (int i = 0; i < 4; ++i) {
+    REQUIRE(q.try_push(i));
+  }
+  REQUIRE_FALSE(q.try_push(4));
+  REQUIRE(q.size()==4);
+
+  std::vector<int> batch;
+  REQUIRE(q.try_pop(std::back_inserter(batch), 3)==3);
+  REQUIRE(batch==std::vector<int>{0, 1, 2});
+  // Wraps around the ring
+  REQUIRE(q.try_push(4));
+  REQUIRE(q.try_pop(std::back_inserter(batch), 8)==2);
+  REQUIRE(batch==std::vector<int>{0, 1, 2, 3, 4});
+  REQUIRE(q.size()==0);
+}
+
+TEMPLATE_TEST_CASE("Bounded queue moves items", "[BoundedQueue]", container::mpmc, container::spsc) {
+  container::BoundedQueue<std::unique_ptr<int>, TestType> q{2};
+  REQUIRE(q.try_push(std::make_unique<int>(1)));
+  REQUIRE(q.try_push(std::make_unique<int>(2)));
+  auto rejected = std::make_unique<int>(3);
+  REQUIRE_FALSE(q.try_push(std::move(rejected)));
+  // A failed push leaves the item with the caller
+  REQUIRE(rejected!=nullptr);
+  REQUIRE(*q.pop()==1);
+  // One item is left for the destructor
+}
+
+TEST_CASE("Bounded queue blocks until an item arrives", "[BoundedQueue]") {
+  container::BoundedQueue<int> q{4};
+  std::thread consumer([&] { REQUIRE(q.pop()==42); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  q.push(42);
+  consumer.join();
+}
+
+TEST_CASE("Bounded MPMC queue delivers every item once", "[BoundedQueue]") {
+  constexpr int PRODUCERS = 4;
+  constexpr int CONSUMERS = 4;
+  constexpr int ITEMS = 50000;
+  container::BoundedQueue<int> q{64};
+  std::vector<std::atomic<int>> seen(PRODUCERS*ITEMS);
+  std::atomic<int> popped{0};
+
+  std::vector<std::thread> threads;
+  for (int p = 0; p < PRODUCERS; ++p) {
+    threads.emplace_back([&, p] {
+      for (int i = 0; i < ITEMS; ++i) {
+        q.push(p*ITEMS + i);
+      }
+    });
+  }
+  for (int c = 0; c < CONSUMERS; ++c) {
+    threads.emplace_back([&] {
+      std::vector<int> batch;
+      while (popped.load() < PRODUCERS*ITEMS) {
+        batch.clear();
+        if (q.try_pop(std::back_inserter(batch), 16)==0) {
+          std::this_thread::yield();
+          continue;
+        }
+        for (auto v : batch) {
+          seen[v].fetch_add(1);
+        }
+        popped.fetch_add(static_cast<int>(batch.size()));
+      }
+    });
+  }
+  for (auto &t : threads) {
+    t.join();
+  }
+  REQUIRE(popped.load()==PRODUCERS*ITEMS);
+  REQUIRE(std::all_of(seen.begin(), seen.end(), [](const std::atomic<int> &s) { return s.load()==1; }));
+}
+
+TEST_CASE("Bounded SPSC queue keeps order under backpressure", "[BoundedQueue]") {
+  constexpr int ITEMS = 200000;
+  container::BoundedQueue<int, container::spsc> q{16};
+  std::thread producer([&] {
+    for (int i = 0; i < ITEMS; ++i) {
+      q.push(i);
+    }
+  });
+  std::vector<int> batch;
+  int expected = 0;
+  bool ordered = true;
+  while (expected < ITEMS) {
+    batch.clear();
+    q.pop(std::back_inserter(batch), 8);
+    for (auto v : batch) {
+      ordered = ordered && v==expected;
+      ++expected;
+    }
+  }
+  producer.join();
+  REQUIRE(ordered);
+  REQUIRE(expected==ITEMS);
+}
@@ -24,6 +24,8 @@ TEST_CASE("Configuration initialization", "[config]") {
 TEST_CASE("Configuration initialization with undeclared env vars", "[config]") {
   gossip::Config config{};
 
+  // Left set by the cases before
+  ::unsetenv("MY_ID");
   ::setenv("ADDRESS", "127.0.0.1:5000", 1);
   ::setenv("SEEDS", "1=127.0.0.1:5001,2=127.0.0.1:5002", 1);
 
@@ -31,4 +33,87 @@ TEST_CASE("Configuration initialization with undeclared env vars", "[config]") {
   REQUIRE(config.get_my_address().empty());
   REQUIRE(config.get_my_id().empty());
   REQUIRE(config.get_seeds().empty());
-}
\ No newline at end of file
+}
+TEST_CASE("Configuration with receive options", "[config]") {
+  gossip::Config config{};
+  ::setenv("MY_ID", "1234", 1);
+  ::setenv("ADDRESS", "127.0.0.1:5000", 1);
+  ::setenv("SEEDS", "1=127.0.0.1:5001", 1);
+  ::setenv("RECV_BUFFER", "4194304", 1);
+  ::setenv("RECV_BATCH", "128", 1);
+  ::setenv("LISTENERS", "4", 1);
+  ::setenv("FULL_SYNC_ROUNDS", "10", 1);
+  ::setenv("MTU", "1400", 1);
+  ::setenv("WIRE_VERSION", "2", 1);
+  ::setenv("IO_BACKEND", "io_uring", 1);
+  ::setenv("PEER_SELECTION", "round_robin", 1);
+  ::setenv("FAILURE_DETECTOR", "phi", 1);
+  ::setenv("PHI_THRESHOLD", "10.5", 1);
+  ::setenv("SWIM_INDIRECT", "5", 1);
+
+  REQUIRE(config.init());
+  REQUIRE(config.get_recv_buffer()==4194304);
+  REQUIRE(config.get_recv_batch()==128);
+  REQUIRE(config.get_listeners()==4);
+  REQUIRE(config.get_full_sync_rounds()==10);
+  REQUIRE(config.get_mtu()==1400);
+  REQUIRE(config.get_wire_version()==2);
+#ifdef GSPD_IO_URING
+  REQUIRE(config.get_io_backend()=="io_uring");
+#else
+  REQUIRE(config.get_io_backend()=="syscalls");
+#endif
+  REQUIRE(config.get_peer_selection()=="round_robin");
+  REQUIRE(config.get_failure_detector()=="phi");
+  REQUIRE(config.get_phi_threshold()==10.5);
+  REQUIRE(config.get_swim_indirect()==5);
+
+  ::unsetenv("RECV_BUFFER");
+  ::unsetenv("RECV_BATCH");
+  ::unsetenv("LISTENERS");
+  ::unsetenv("FULL_SYNC_ROUNDS");
+  ::unsetenv("MTU");
+  ::unsetenv("WIRE_VERSION");
+  ::unsetenv("IO_BACKEND");
+  ::unsetenv("PEER_SELECTION");
+  ::unsetenv("FAILURE_DETECTOR");
+  ::unsetenv("PHI_THRESHOLD");
+  ::unsetenv("SWIM_INDIRECT");
+}
+
+TEST_CASE("Configuration keeps defaults on malformed values", "[config]") {
+  gossip::Config config{};
+  ::setenv("MY_ID", "1234", 1);
+  ::setenv("ADDRESS", "127.0.0.1:5000", 1);
+  ::setenv("SEEDS", "1=127.0.0.1:5001", 1);
+  ::setenv("RECV_BUFFER", "abc", 1);
+  ::setenv("RECV_BATCH", "12x", 1);
+  ::setenv("LISTENERS", "four", 1);
+  ::setenv("FULL_SYNC_ROUNDS", "1e3", 1);
+  ::setenv("MTU", "70000", 1);
+  ::setenv("WIRE_VERSION", "v2", 1);
+  ::setenv("PHI_THRESHOLD", "high", 1);
+  ::setenv("SWIM_INDIRECT", "-1", 1);
+  ::setenv("FAILURE_DETECTOR", "gossip", 1);
+
+  REQUIRE(config.init());
+  REQUIRE(config.get_recv_buffer()==0);
+  REQUIRE(config.get_recv_batch()==64);
+  REQUIRE(config.get_listeners()==1);
+  REQUIRE(config.get_full_sync_rounds()==1);
+  REQUIRE(config.get_mtu()==2048);
+  REQUIRE(config.get_wire_version()==1);
+  REQUIRE(config.get_phi_threshold()==8.0);
+  REQUIRE(config.get_swim_indirect()==3);
+  REQUIRE(config.get_failure_detector()=="fixed");
+
+  ::unsetenv("RECV_BUFFER");
+  ::unsetenv("RECV_BATCH");
+  ::unsetenv("LISTENERS");
+  ::unsetenv("FULL_SYNC_ROUNDS");
+  ::unsetenv("MTU");
+  ::unsetenv("WIRE_VERSION");
+  ::unsetenv("PHI_THRESHOLD");
+  ::unsetenv("SWIM_INDIRECT");
+  ::unsetenv("FAILURE_DETECTOR");
+}
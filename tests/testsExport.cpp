@@ -0,0 +1,273 @@
+#include <string>
+#include <vector>
+#include <catch2/catch.hpp>
+#include "Export.hpp"
+
+namespace {
+std::string id(int i) {
+  return "node-" + std::string(i < 10 ? "0" : "") + std::to_string(i);
+}
+
+// 25 peers, every fifth one suspected
+void fill(gossip::Members &members) {
+  for (int i = 0; i < 25; ++i) {
+    gossip::Peer p{id(i), "127.0.0.1:" + std::to_string(7000 + i)};
+    members.add_peer(p);
+  }
+  for (int i = 0; i < 25; i += 5) {
+    members.to_suspected(id(i));
+  }
+  members.publish();
+}
+
+std::vector<std::string> ids(const gossip::SnapshotIndex::Page &page) {
+  std::vector<std::string> out;
+  for (const auto *p : page.alive) {
+    out.push_back(p->get_id());
+  }
+  for (const auto *p : page.suspects) {
+    out.push_back(p->get_id());
+  }
+  std::sort(out.begin(), out.end());
+  return out;
+}
+
+// Walks every page of q, returns the ids in the order served
+std::vector<std::string> walk(const gossip::SnapshotIndex &index, gossip::SnapshotIndex::Query q, int *pages) {
+  std::vector<std::string> out;
+  gossip::SnapshotIndex::Page page;
+  std::string cursor;
+  *pages = 0;
+  do {
+    q.after = cursor;
+    index.page(q, page);
+    ++*pages;
+    auto page_ids = ids(page);
+    out.insert(out.end(), page_ids.begin(), page_ids.end());
+    cursor = page.next;
+  } while (!cursor.empty());
+  return out;
+}
+
+// Compact JSON text from the SAX calls of write_page
+struct TextWriter {
+  std::string out;
+  bool comma = false;
+
+  void value(const std::string &v) {
+    if (comma) {
+      out += ',';
+    }
+    out += v;
+    comma = true;
+  }
+  void StartObject() {
+    value("{");
+    comma = false;
+  }
+  void EndObject() {
+    out += '}';
+    comma = true;
+  }
+  void StartArray() {
+    value("[");
+    comma = false;
+  }
+  void EndArray() {
+    out += ']';
+    comma = true;
+  }
+  // Keys and values alternate inside objects, a key is followed by ':'
+  void String(const char *s) {
+    value("\"" + std::string(s) + "\"");
+  }
+  void Uint(unsigned int v) {
+    value(std::to_string(v));
+  }
+  void Uint64(std::uint64_t v) {
+    value(std::to_string(v));
+  }
+  void Null() {
+    value("null");
+  }
+};
+
+struct Strings : msgpack::null_visitor {
+  std::vector<std::string> strings;
+  std::size_t maps = 0;
+
+  bool visit_str(const char *s, std::uint32_t n) {
+    strings.emplace_back(s, n);
+    return true;
+  }
+  bool start_map(std::uint32_t) {
+    ++maps;
+    return true;
+  }
+};
+} // namespace
+
+TEST_CASE("Snapshot pages walk the table in id order", "[export]") {
+  gossip::Members members{};
+  fill(members);
+  gossip::SnapshotIndex index{members.snapshot()};
+
+  gossip::SnapshotIndex::Query q;
+  q.limit = 10;
+  int pages;
+  auto all = walk(index, q, &pages);
+  REQUIRE(pages==3);
+  REQUIRE(all.size()==25);
+  for (int i = 0; i < 25; ++i) {
+    REQUIRE(all[i]==id(i));
+  }
+
+  // The last page has no cursor even when it is full
+  q.limit = 25;
+  gossip::SnapshotIndex::Page page;
+  index.page(q, page);
+  REQUIRE(page.alive.size()==20);
+  REQUIRE(page.suspects.size()==5);
+  REQUIRE(page.next.empty());
+
+  // Out of range limits are clamped
+  q.limit = 0;
+  index.page(q, page);
+  REQUIRE(ids(page)==std::vector<std::string>{id(0)});
+  REQUIRE(page.next==id(0));
+}
+
+TEST_CASE("Snapshot pages filter by state and id prefix", "[export]") {
+  gossip::Members members{};
+  fill(members);
+  gossip::SnapshotIndex index{members.snapshot()};
+  gossip::SnapshotIndex::Query q;
+  q.limit = 4;
+  int pages;
+
+  q.state = gossip::SnapshotIndex::State::suspect;
+  REQUIRE(walk(index, q, &pages)==std::vector<std::string>{id(0), id(5), id(10), id(15), id(20)});
+  REQUIRE(pages==2);
+
+  q.state = gossip::SnapshotIndex::State::alive;
+  auto alive = walk(index, q, &pages);
+  REQUIRE(alive.size()==20);
+  REQUIRE(std::find(alive.begin(), alive.end(), id(5))==alive.end());
+
+  q.state = gossip::SnapshotIndex::State::all;
+  q.prefix = "node-1";
+  auto tens = walk(index, q, &pages);
+  REQUIRE(tens.size()==10);
+  REQUIRE(tens.front()==id(10));
+  REQUIRE(tens.back()==id(19));
+
+  q.prefix = "other";
+  REQUIRE(walk(index, q, &pages).empty());
+}
+
+TEST_CASE("Snapshot cursor carries over to a newer snapshot", "[export]") {
+  gossip::Members members{};
+  fill(members);
+  gossip::IndexCache cache;
+  auto index = cache.get(members);
+  REQUIRE(cache.get(members)==index);
+
+  gossip::SnapshotIndex::Query q;
+  q.limit = 10;
+  gossip::SnapshotIndex::Page page;
+  index->page(q, page);
+  auto cursor = page.next;
+  REQUIRE(cursor==id(9));
+
+  // Joins before and after the cursor, only the later one is on the next pages
+  gossip::Peer early{"node-03a", "127.0.0.1:8000"};
+  gossip::Peer late{"node-13a", "127.0.0.1:8001"};
+  members.add_peer(early);
+  members.add_peer(late);
+  REQUIRE(members.publish());
+  auto newer = cache.get(members);
+  REQUIRE(newer!=index);
+  REQUIRE(newer->version() > index->version());
+
+  q.after = cursor;
+  q.limit = 100;
+  newer->page(q, page);
+  auto rest = ids(page);
+  REQUIRE(rest.size()==16);
+  REQUIRE(std::find(rest.begin(), rest.end(), "node-13a")!=rest.end());
+  REQUIRE(std::find(rest.begin(), rest.end(), "node-03a")==rest.end());
+}
+
+TEST_CASE("Snapshot index reuses the order of the previous one", "[export]") {
+  gossip::Members members{};
+  fill(members);
+  gossip::IndexCache cache;
+  auto index = cache.get(members);
+
+  // Only heartbeats move, every peer stays at its place in the snapshot
+  gossip::Peer peer{id(7), "127.0.0.1:7007"};
+  peer.heartbeat(5);
+  members.heartbeat(peer);
+  REQUIRE(members.publish());
+  auto newer = cache.get(members);
+  REQUIRE(newer->version() > index->version());
+
+  gossip::SnapshotIndex::Query q;
+  q.limit = 100;
+  gossip::SnapshotIndex::Page page;
+  newer->page(q, page);
+  REQUIRE(page.alive.size()==20);
+  REQUIRE(page.suspects.size()==5);
+  for (std::size_t i = 1; i < page.alive.size(); ++i) {
+    REQUIRE(page.alive[i - 1]->get_id() < page.alive[i]->get_id());
+  }
+  auto seven = std::find_if(page.alive.begin(), page.alive.end(), [](const gossip::Peer *p) {
+    return p->get_id()==id(7);
+  });
+  REQUIRE(seven!=page.alive.end());
+  REQUIRE((*seven)->get_heartbeat()==5);
+  // Pointers are into the newer snapshot, not the one of the reused order
+  auto snapshot = members.snapshot();
+  REQUIRE(*seven >= snapshot->alive.data());
+  REQUIRE(*seven < snapshot->alive.data() + snapshot->alive.size());
+
+  // A peer leaving alive changes the lists, the index is sorted again
+  members.to_suspected(id(8));
+  REQUIRE(members.publish());
+  cache.get(members)->page(q, page);
+  REQUIRE(page.alive.size()==19);
+  REQUIRE(page.suspects.size()==6);
+  for (std::size_t i = 1; i < page.suspects.size(); ++i) {
+    REQUIRE(page.suspects[i - 1]->get_id() < page.suspects[i]->get_id());
+  }
+}
+
+TEST_CASE("Snapshot pages are written as compact JSON and msgpack", "[export]") {
+  gossip::Members members{};
+  gossip::Peer a{"a", "127.0.0.1:7000"};
+  gossip::Peer b{"b", "127.0.0.1:7001"};
+  members.add_peer(a);
+  members.add_peer(b);
+  members.to_suspected("b");
+  members.publish();
+  gossip::SnapshotIndex index{members.snapshot()};
+  gossip::SnapshotIndex::Query q;
+  q.limit = 1;
+  gossip::SnapshotIndex::Page page;
+  index.page(q, page);
+
+  TextWriter json;
+  gossip::write_page(json, page, index.version());
+  REQUIRE(json.out==R"({"version",)" + std::to_string(index.version())
+      + R"(,"peers",{"alive",[{"id","a","address","127.0.0.1:7000","heartbeat",1}],"suspects",[]},"next","a"})");
+
+  msgpack::sbuffer sbuf;
+  msgpack::packer<msgpack::sbuffer> pk(sbuf);
+  gossip::pack_page(pk, page, index.version());
+  Strings visitor;
+  std::size_t off = 0;
+  REQUIRE(msgpack::parse(sbuf.data(), sbuf.size(), off, visitor));
+  REQUIRE(off==sbuf.size());
+  REQUIRE(visitor.maps==1);
+  REQUIRE(visitor.strings==std::vector<std::string>{"version", "alive", "a", "127.0.0.1:7000", "suspects", "next", "a"});
+}
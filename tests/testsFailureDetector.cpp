@@ -0,0 +1,116 @@
+#include <catch2/catch.hpp>
+#include "gossip.hpp"
+
+using namespace std::chrono_literals;
+
+TEST_CASE("Phi accrual follows heartbeat intervals", "[detector]") {
+  gossip::PhiAccrual detector{8.0, 10ms, 0ms, 100ms};
+  auto now = std::chrono::steady_clock::now();
+
+  SECTION("a steady peer is suspected soon after it goes quiet") {
+    for (int i = 0; i < 30; ++i) {
+      detector.heartbeat(1, now);
+      now += 100ms;
+    }
+    auto last = now - 100ms;
+    REQUIRE(detector.phi(1, last + 100ms) < 1.0);
+    REQUIRE(detector.phi(1, last + 300ms) > 8.0);
+    auto deadline = detector.deadline(1, last);
+    REQUIRE(deadline > last + 100ms);
+    REQUIRE(deadline < last + 300ms);
+  }
+
+  SECTION("a jittery peer gets a longer deadline") {
+    for (int i = 0; i < 30; ++i) {
+      detector.heartbeat(1, now);
+      detector.heartbeat(2, now + (i%2 ? 50ms : -50ms));
+      now += 100ms;
+    }
+    auto last = now - 100ms;
+    REQUIRE(detector.deadline(2, last) > detector.deadline(1, last));
+    REQUIRE(detector.phi(2, last + 200ms) < detector.phi(1, last + 200ms));
+  }
+
+  SECTION("a removed peer falls back to its timestamp") {
+    detector.heartbeat(1, now);
+    detector.remove(1);
+    REQUIRE(detector.phi(1, now + 1s)==0.0);
+    REQUIRE(detector.deadline(1, now) > now + 100ms);
+  }
+}
+
+TEST_CASE("Members suspect and remove peers on an injected clock", "[detector]") {
+  gossip::Members members{};
+  auto now = std::chrono::steady_clock::now();
+  members.set_clock([&now] { return now; });
+  members.set_tround(0);
+  members.set_tclean(500);
+
+  SECTION("phi accrual") {
+    members.set_detector(std::make_unique<gossip::PhiAccrual>(8.0, 10ms, 0ms, 100ms));
+    gossip::Peer peer{"123", "127.0.0.1:8080"};
+    for (int i = 0; i < 20; ++i) {
+      peer.inc_heartbeat();
+      members.heartbeat(peer);
+      now += 100ms;
+      members.cleanup_task();
+      REQUIRE(members.is_alive("123"));
+    }
+    now += 50ms;
+    members.cleanup_task();
+    REQUIRE(members.is_alive("123"));
+
+    now += 250ms;
+    members.cleanup_task();
+    REQUIRE(members.is_dead("123"));
+
+    // Deadlines fire on the first wheel tick past them
+    now += 501ms;
+    members.cleanup_task();
+    REQUIRE_FALSE(members.is_dead("123"));
+    REQUIRE_FALSE(members.is_alive("123"));
+  }
+
+  SECTION("fixed timeout") {
+    members.set_tfail(200);
+    gossip::Peer peer{"123", "127.0.0.1:8080"};
+    members.heartbeat(peer);
+    now += 150ms;
+    members.cleanup_task();
+    REQUIRE(members.is_alive("123"));
+    now += 100ms;
+    members.cleanup_task();
+    REQUIRE(members.is_dead("123"));
+  }
+
+  SECTION("wakeup follows the next deadline") {
+    members.set_tfail(200);
+    std::vector<std::chrono::steady_clock::time_point> wakeups;
+    members.set_wakeup([&wakeups](std::chrono::steady_clock::time_point when) { wakeups.push_back(when); });
+    REQUIRE(wakeups.size()==1);
+    REQUIRE(wakeups.back() >= now + 1s);
+
+    gossip::Peer peer{"123", "127.0.0.1:8080"};
+    members.heartbeat(peer);
+    REQUIRE(wakeups.size()==2);
+    REQUIRE(wakeups.back() >= now + 200ms);
+    REQUIRE(wakeups.back() < now + 201ms);
+
+    // A later deadline does not move the wakeup
+    peer.inc_heartbeat();
+    now += 10ms;
+    members.heartbeat(peer);
+    REQUIRE(wakeups.size()==2);
+
+    now = wakeups.back();
+    members.cleanup_task();
+    REQUIRE(members.is_alive("123"));
+    REQUIRE(wakeups.back()==now + 10ms);
+
+    now = wakeups.back();
+    members.cleanup_task();
+    REQUIRE(members.is_dead("123"));
+    REQUIRE(wakeups.back() >= now + 500ms);
+    REQUIRE(wakeups.back() < now + 501ms);
+  }
+}
@@ -1,8 +1,31 @@
 #include <catch2/catch.hpp>
 #include <msgpack.hpp>
 #include <iostream>
+#include <map>
+#include <set>
 #include "gossip.hpp"
 
+namespace {
+// Simulated time for the failure detector, run_for ticks cleanup_task every
+// millisecond as the cleanup thread would. Deadlines count from the heartbeat itself.
+struct Clock {
+  gossip::Members &members;
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+  explicit Clock(gossip::Members &m) : members(m) {
+    members.set_clock([this] { return now; });
+    members.set_tround(0);
+  }
+
+  void run_for(std::chrono::milliseconds d) {
+    for (auto end = now + d; now < end;) {
+      now += std::chrono::milliseconds(1);
+      members.cleanup_task();
+    }
+  }
+};
+} // namespace
+
 TEST_CASE("Members should be handled by gossip", "[members]") {
   SECTION("Member is not known") {
     gossip::Members members{};
@@ -60,24 +83,23 @@ TEST_CASE("Members should be handled by gossip", "[members]") {
 
   SECTION("Move to dead after timeout") {
     gossip::Members members{};
-    members.start_cleanup();
+    Clock clock{members};
     members.set_tfail(50);
     members.set_tclean(150);
     gossip::Peer peer{"123", "127.0.0.1:8080"};
     peer.inc_heartbeat();
     members.heartbeat(peer);
     REQUIRE(members.is_alive(peer.get_id()));
-    std::this_thread::sleep_for(std::chrono::milliseconds(100));
-    members.stop_cleanup();
+    clock.run_for(std::chrono::milliseconds(100));
     REQUIRE(members.is_dead(peer.get_id()));
     REQUIRE_FALSE(members.is_alive(peer.get_id()));
   }
 
   SECTION("receive message for suspect with the same heartbeat") {
     gossip::Members members{};
+    Clock clock{members};
     members.set_tfail(50);
     members.set_tclean(150);
-    members.start_cleanup();
     gossip::Peer peer{"123", "127.0.0.1:8080"};
     peer.inc_heartbeat();
     gossip::Peer peer2{"123", "127.0.0.1:8080"};
@@ -85,8 +107,7 @@ TEST_CASE("Members should be handled by gossip", "[members]") {
     members.heartbeat(peer);
     std::string id = peer.get_id();
     REQUIRE(members.is_alive(id));
-    std::this_thread::sleep_for(std::chrono::milliseconds(80));
-    members.stop_cleanup();
+    clock.run_for(std::chrono::milliseconds(80));
     REQUIRE_FALSE(members.is_alive(id));
     members.heartbeat(peer2);
     REQUIRE_FALSE(members.is_alive(id));
@@ -94,9 +115,9 @@ TEST_CASE("Members should be handled by gossip", "[members]") {
 
   SECTION("receive message for suspect with larger heartbeat") {
     gossip::Members members{};
+    Clock clock{members};
     members.set_tfail(50);
     members.set_tclean(150);
-    members.start_cleanup();
     gossip::Peer peer{"123", "127.0.0.1:8080"};
     peer.inc_heartbeat();
     gossip::Peer peer2{"123", "127.0.0.1:8080"};
@@ -104,35 +125,33 @@ TEST_CASE("Members should be handled by gossip", "[members]") {
     members.heartbeat(peer);
     std::string id = peer.get_id();
     REQUIRE(members.is_alive(id));
-    std::this_thread::sleep_for(std::chrono::milliseconds(70));
+    clock.run_for(std::chrono::milliseconds(70));
     REQUIRE(members.is_dead(id));
     members.heartbeat(peer2);
-    members.stop_cleanup();
     REQUIRE(members.is_alive(id));
   }
 
   SECTION("cleanup dead after timeout") {
     gossip::Members members{};
+    Clock clock{members};
     members.set_tfail(50);
     members.set_tclean(70);
-    members.start_cleanup();
     gossip::Peer peer{"123", "127.0.0.1:8080"};
     peer.inc_heartbeat();
     members.heartbeat(peer);
     std::string id = peer.get_id();
     REQUIRE(members.is_alive(id));
-    std::this_thread::sleep_for(std::chrono::milliseconds(70));
+    clock.run_for(std::chrono::milliseconds(70));
     REQUIRE_FALSE(members.is_alive(id));
-    std::this_thread::sleep_for(std::chrono::milliseconds(60));
-    members.stop_cleanup();
+    clock.run_for(std::chrono::milliseconds(60));
     REQUIRE_FALSE(members.is_dead(id));
   }
 
   SECTION("timer should not be triggered when heartbeat received") {
     gossip::Members members{};
+    Clock clock{members};
     members.set_tfail(50);
     members.set_tclean(150);
-    members.start_cleanup();
     gossip::Peer peer{"123", "127.0.0.1:8080"};
     gossip::Peer peer2{"123", "127.0.0.1:8080"};
     gossip::Peer peer3{"123", "127.0.0.1:8080"};
@@ -140,22 +159,21 @@ TEST_CASE("Members should be handled by gossip", "[members]") {
     members.heartbeat(peer);
     std::string id = peer.get_id();
     REQUIRE(members.is_alive(id));
-    std::this_thread::sleep_for(std::chrono::milliseconds(25));
+    clock.run_for(std::chrono::milliseconds(25));
     peer2.heartbeat(3);
     members.heartbeat(peer2);
     REQUIRE(members.is_alive(id));
-    std::this_thread::sleep_for(std::chrono::milliseconds(25));
+    clock.run_for(std::chrono::milliseconds(25));
     peer3.heartbeat(4);
     members.heartbeat(peer3);
-    members.stop_cleanup();
     REQUIRE(members.is_alive(id));
   }
 
   SECTION("timer cleanup should not be triggered when heartbeat received") {
     gossip::Members members{};
+    Clock clock{members};
     members.set_tfail(50);
     members.set_tclean(150);
-    members.start_cleanup();
     gossip::Peer peer{"123", "127.0.0.1:8080"};
     gossip::Peer peer2{"123", "127.0.0.1:8080"};
     gossip::Peer peer3{"123", "127.0.0.1:8080"};
@@ -163,14 +181,13 @@ TEST_CASE("Members should be handled by gossip", "[members]") {
     members.heartbeat(peer);
     std::string id = peer.get_id();
     REQUIRE(members.is_alive(id));
-    std::this_thread::sleep_for(std::chrono::milliseconds(60));
+    clock.run_for(std::chrono::milliseconds(60));
     peer2.heartbeat(3);
     members.heartbeat(peer2);
     REQUIRE(members.is_alive(id));
-    std::this_thread::sleep_for(std::chrono::milliseconds(25));
+    clock.run_for(std::chrono::milliseconds(25));
     peer3.heartbeat(4);
     members.heartbeat(peer3);
-    members.stop_cleanup();
     REQUIRE(members.is_alive(id));
   }
 
@@ -219,6 +236,231 @@ TEST_CASE("Members should be handled by gossip", "[members]") {
     REQUIRE(res!=expected.end());
   }
 
+  SECTION("Random peers are distinct, never me and uniform") {
+    gossip::Members members{};
+    members.set_me("me");
+    gossip::Peer me{"me", "127.0.0.1:8080"};
+    members.add_peer(me);
+    for (int i = 0; i < 10; ++i) {
+      gossip::Peer p{std::to_string(i), "127.0.0.1:8080"};
+      members.add_peer(p);
+    }
+    members.to_suspected("9");
+
+    std::map<std::string, int> counts;
+    std::vector<gossip::Peer> k;
+    for (int i = 0; i < 9000; ++i) {
+      members.get_random_peers(3, k);
+      REQUIRE(k.size()==3);
+      REQUIRE(k[0].get_id()!=k[1].get_id());
+      REQUIRE(k[0].get_id()!=k[2].get_id());
+      REQUIRE(k[1].get_id()!=k[2].get_id());
+      for (const auto &p : k) {
+        ++counts[p.get_id()];
+      }
+    }
+    REQUIRE(counts.size()==9);
+    REQUIRE(counts.count("me")==0);
+    for (const auto &c : counts) {
+      REQUIRE(c.second > 2700);
+      REQUIRE(c.second < 3300);
+    }
+
+    members.get_random_peers(20, k);
+    REQUIRE(k.size()==9);
+  }
+
+  SECTION("Round robin contacts every peer within N/k rounds") {
+    gossip::Members members{};
+    members.set_me("me");
+    gossip::Peer me{"me", "127.0.0.1:8080"};
+    members.add_peer(me);
+    for (int i = 0; i < 10; ++i) {
+      gossip::Peer p{std::to_string(i), "127.0.0.1:8080"};
+      members.add_peer(p);
+    }
+
+    gossip::RoundRobin rr;
+    std::vector<gossip::Peer> k;
+    for (int pass = 0; pass < 3; ++pass) {
+      std::set<std::string> seen;
+      for (int round = 0; round < 4; ++round) {
+        rr.next(members, 3, k);
+        REQUIRE(k.size()==3);
+        for (const auto &p : k) {
+          seen.insert(p.get_id());
+        }
+      }
+      REQUIRE(seen.size()==10);
+      REQUIRE(seen.count("me")==0);
+      // 12 picks per pass of 10, realign on the pass boundary
+      rr.next(members, 8, k);
+    }
+
+    members.to_suspected("3");
+    std::set<std::string> seen;
+    for (int round = 0; round < 3; ++round) {
+      rr.next(members, 3, k);
+      for (const auto &p : k) {
+        seen.insert(p.get_id());
+      }
+    }
+    REQUIRE(seen.count("3")==0);
+  }
+
+  SECTION("cleanup only removes suspected peers") {
+    gossip::Members members{};
+    gossip::Peer peer{"123", "127.0.0.1:8080"};
+    members.add_peer(peer);
+    members.cleanup(peer.get_id());
+    REQUIRE(members.is_alive(peer.get_id()));
+    members.to_suspected(peer.get_id());
+    REQUIRE(members.is_dead(peer.get_id()));
+    members.cleanup(peer.get_id());
+    REQUIRE_FALSE(members.is_dead(peer.get_id()));
+    REQUIRE_FALSE(members.is_alive(peer.get_id()));
+  }
+
+  SECTION("Concurrent heartbeats across shards") {
+    gossip::Members members{};
+    std::vector<std::thread> writers;
+    for (int w = 0; w < 4; ++w) {
+      writers.emplace_back([&members, w] {
+        for (unsigned int hb = 2; hb < 50; ++hb) {
+          for (int i = 0; i < 64; ++i) {
+            gossip::Peer p{std::to_string(i), "127.0.0.1:" + std::to_string(6000 + i)};
+            p.heartbeat(hb + w);
+            members.heartbeat(p);
+          }
+        }
+      });
+    }
+    for (int i = 0; i < 32; ++i) {
+      members.to_suspected(std::to_string(i));
+    }
+    for (auto &t : writers) {
+      t.join();
+    }
+    REQUIRE(members.size() + members.get_suspected_peers().size()==64);
+    for (const auto &p : members.get_alive_peers()) {
+      REQUIRE(members.get_peer(p.get_id())->get_heartbeat()==52);
+    }
+  }
+
+  SECTION("Interner hands out one stable handle per string") {
+    gossip::Interner ids;
+    auto a = ids.intern("node-a.gspd.cluster.local");
+    auto b = ids.intern("127.0.0.1:8080");
+    REQUIRE(a!=b);
+    REQUIRE(ids.intern("node-a.gspd.cluster.local")==a);
+    REQUIRE(ids.find("127.0.0.1:8080")==b);
+    REQUIRE(ids.find("unknown")==gossip::no_handle);
+    REQUIRE(ids.get(a)=="node-a.gspd.cluster.local");
+    REQUIRE(ids.size()==2);
+  }
+
+  SECTION("Peers get handles when they enter the table") {
+    gossip::Members members{};
+    gossip::Peer peer{"123", "127.0.0.1:8080"};
+    members.heartbeat(peer);
+    auto stored = members.get_peer("123");
+    REQUIRE(stored->get_handle()!=gossip::no_handle);
+    REQUIRE(stored->get_address_handle()!=gossip::no_handle);
+    REQUIRE(members.get_alive_peers().front().get_handle()==stored->get_handle());
+  }
+
+  SECTION("Heartbeat straight from decoded fields") {
+    gossip::Members members{};
+    std::string buf = "123127.0.0.1:8080";
+    std::string_view id(buf.data(), 3);
+    std::string_view address(buf.data() + 3, 14);
+    members.heartbeat(id, address, 5);
+    buf.assign(buf.size(), 'x');
+    auto stored = members.get_peer("123");
+    REQUIRE(stored->get_id()=="123");
+    REQUIRE(stored->get_address()=="127.0.0.1:8080");
+    REQUIRE(stored->get_heartbeat()==5);
+    members.heartbeat("123", "127.0.0.1:8080", 4);
+    REQUIRE(stored->get_heartbeat()==5);
+    members.heartbeat("123", "127.0.0.1:8080", 7);
+    REQUIRE(stored->get_heartbeat()==7);
+  }
+
+  SECTION("Delta sync sends what changed in the last rounds") {
+    gossip::Members members{};
+    members.set_me("me");
+    gossip::Peer me{"me", "127.0.0.1:8080"};
+    gossip::Peer peer{"123", "127.0.0.1:8081"};
+    gossip::Peer peer2{"456", "127.0.0.1:8082"};
+    members.add_peer(me);
+    members.add_peer(peer);
+    members.add_peer(peer2);
+
+    gossip::DeltaSync delta{5, 2};
+    std::vector<gossip::Peer> out;
+    REQUIRE(delta.begin_round(members));
+
+    // Nothing changed since the full round
+    REQUIRE_FALSE(delta.begin_round(members));
+    delta.next(members, out);
+    REQUIRE(out.empty());
+
+    REQUIRE_FALSE(delta.begin_round(members));
+    members.beat();
+    delta.next(members, out);
+    REQUIRE(out.size()==1);
+    REQUIRE(out[0].get_id()=="me");
+
+    // The delta above is lost, the next round still carries it with the new change
+    REQUIRE_FALSE(delta.begin_round(members));
+    peer2.heartbeat(5);
+    members.heartbeat(peer2);
+    delta.next(members, out);
+    REQUIRE(out.size()==2);
+
+    // Past the window only the newer change is left
+    REQUIRE_FALSE(delta.begin_round(members));
+    delta.next(members, out);
+    REQUIRE(out.size()==1);
+    REQUIRE(out[0].get_id()=="456");
+
+    REQUIRE(delta.begin_round(members));
+  }
+
+  SECTION("Snapshots are published only when the table changed") {
+    gossip::Members members{};
+    auto empty = members.snapshot();
+    REQUIRE(empty->alive.empty());
+    REQUIRE_FALSE(members.publish());
+
+    gossip::Peer peer{"123", "127.0.0.1:8080"};
+    gossip::Peer peer2{"456", "127.0.0.1:8081"};
+    members.add_peer(peer);
+    REQUIRE(members.publish());
+    auto first = members.snapshot();
+    REQUIRE(first->alive.size()==1);
+    REQUIRE_FALSE(members.publish());
+    REQUIRE(members.snapshot()==first);
+
+    // A reader holding the old snapshot keeps seeing it unchanged
+    members.add_peer(peer2);
+    members.to_suspected(peer.get_id());
+    REQUIRE(members.publish());
+    auto second = members.snapshot();
+    REQUIRE(second->version > first->version);
+    REQUIRE(first->alive.size()==1);
+    REQUIRE(first->suspects.empty());
+    REQUIRE(second->alive.size()==1);
+    REQUIRE(second->alive[0].get_id()=="456");
+    REQUIRE(second->suspects.size()==1);
+    REQUIRE(second->suspects[0].get_id()=="123");
+
+    // Removal changes the table too
+    members.cleanup(peer.get_id());
+    REQUIRE(members.publish());
+    REQUIRE(members.snapshot()->suspects.empty());
+  }
+
   SECTION("deserialize Peer") {
     gossip::Peer peer{"123", "127.0.0.1:8080"};
     gossip::Peer peer2{"456", "127.0.0.1:8081"};
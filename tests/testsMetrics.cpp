@@ -0,0 +1,143 @@
+#include <string>
+#include <thread>
+#include <vector>
+#include <catch2/catch.hpp>
+#include "gossip.hpp"
+#include "Metrics.hpp"
+
+using namespace std::chrono_literals;
+
+TEST_CASE("Counter sums the adds of every thread", "[metrics]") {
+  gossip::Counter c;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 8; ++t) {
+    threads.emplace_back([&c] {
+      for (int i = 0; i < 10000; ++i) {
+        c.add();
+      }
+      c.add(5);
+    });
+  }
+  for (auto &t : threads) {
+    t.join();
+  }
+  REQUIRE(c.value()==8*10005);
+}
+
+TEST_CASE("Histogram buckets durations by upper bound", "[metrics]") {
+  gossip::Histogram h{{1ms, 10ms}};
+  h.observe(500us);
+  h.observe(1ms);
+  h.observe(5ms);
+  h.observe(1s);
+  REQUIRE(h.count(0)==2);
+  REQUIRE(h.count(1)==1);
+  REQUIRE(h.count(2)==1);
+  REQUIRE(h.count()==4);
+  REQUIRE(h.sum()==Approx(1.0065));
+
+  gossip::Histogram hops{{1, 2, 4}};
+  hops.observe(1);
+  hops.observe(3);
+  hops.observe(7);
+  REQUIRE(hops.count(0)==1);
+  REQUIRE(hops.count(2)==1);
+  REQUIRE(hops.count(3)==1);
+  REQUIRE(hops.bound(2)==4);
+  REQUIRE(hops.sum()==11);
+}
+
+TEST_CASE("Registry renders the text exposition format", "[metrics]") {
+  gossip::Counter c;
+  c.add(3);
+  gossip::Histogram h{{1ms, 10ms}};
+  h.observe(500us);
+  h.observe(5ms);
+  h.observe(20ms);
+
+  gossip::Registry registry;
+  registry.counter("events_total", "Events.", c);
+  registry.gauge("size", "Size.", [] { return 7; });
+  registry.histogram("tick_seconds", "Ticks.", h);
+  REQUIRE(registry.text()==
+      "# HELP events_total Events.\n"
+      "# TYPE events_total counter\n"
+      "events_total 3\n"
+      "# HELP size Size.\n"
+      "# TYPE size gauge\n"
+      "size 7\n"
+      "# HELP tick_seconds Ticks.\n"
+      "# TYPE tick_seconds histogram\n"
+      "tick_seconds_bucket{le=\"0.001\"} 1\n"
+      "tick_seconds_bucket{le=\"0.01\"} 2\n"
+      "tick_seconds_bucket{le=\"+Inf\"} 3\n"
+      "tick_seconds_sum 0.0255\n"
+      "tick_seconds_count 3\n");
+}
+
+TEST_CASE("Members count heartbeats and failure detection events", "[metrics]") {
+  gossip::Members members{};
+  auto now = std::chrono::steady_clock::now();
+  members.set_clock([&now] { return now; });
+  members.set_tround(0);
+  members.set_tclean(500);
+  members.set_tfail(200);
+  const auto &m = members.metrics();
+
+  gossip::Peer peer{"123", "127.0.0.1:8080"};
+  members.heartbeat(peer);
+  members.heartbeat(peer);
+  REQUIRE(m.heartbeats_applied.value()==1);
+  REQUIRE(m.heartbeats_stale.value()==1);
+
+  now += 250ms;
+  members.cleanup_task();
+  REQUIRE(m.suspicions.value()==1);
+
+  peer.inc_heartbeat();
+  members.heartbeat(peer);
+  REQUIRE(m.recoveries.value()==1);
+  REQUIRE(m.heartbeats_applied.value()==2);
+
+  now += 250ms;
+  members.cleanup_task();
+  now += 501ms;
+  members.cleanup_task();
+  REQUIRE(m.suspicions.value()==2);
+  REQUIRE(m.removals.value()==1);
+  REQUIRE(m.cleanup_duration.count()==3);
+}
+
+TEST_CASE("Members observe how far traced heartbeats travelled", "[metrics]") {
+  gossip::Members members{};
+  std::uint64_t wall = 1790000000000000;
+  members.set_trace_clock([&wall] { return wall; });
+  members.set_me("me");
+  gossip::Peer me{"me", "127.0.0.1:8000"};
+  members.add_peer(me);
+  const auto &m = members.metrics();
+
+  // Our own increments start a trace
+  members.beat();
+  auto own = members.get_peer("me")->get_trace();
+  REQUIRE(own.origin==wall);
+  REQUIRE(own.hops==0);
+
+  // A heartbeat incremented 120ms ago two hops away is kept as three hops
+  wall += 120000;
+  members.heartbeat("123", "127.0.0.1:8080", 2, gossip::Trace{wall - 120000, 2});
+  auto kept = members.get_peer("123")->get_trace();
+  REQUIRE(kept.origin==wall - 120000);
+  REQUIRE(kept.hops==3);
+  REQUIRE(m.dissemination_delay.count()==1);
+  REQUIRE(m.dissemination_delay.sum()==Approx(0.12));
+  REQUIRE(m.dissemination_hops.sum()==3);
+
+  // Stale and untraced heartbeats are not observed, an origin ahead of our clock is 0
+  members.heartbeat("123", "127.0.0.1:8080", 2, gossip::Trace{wall, 0});
+  members.heartbeat("123", "127.0.0.1:8080", 3);
+  REQUIRE(members.get_peer("123")->get_trace().origin==0);
+  members.heartbeat("123", "127.0.0.1:8080", 4, gossip::Trace{wall + 1000, 0});
+  REQUIRE(m.dissemination_delay.count()==2);
+  REQUIRE(m.dissemination_delay.count(0)==1);
+}
@@ -0,0 +1,92 @@
+#include <unistd.h>
+#include <thread>
+#include <catch2/catch.hpp>
+#include "Client.hpp"
+#include "Listener.hpp"
+#include "Reactor.hpp"
+
+using namespace std::chrono_literals;
+
+TEST_CASE("Reactor dispatches timers", "[reactor]") {
+  gossip::Reactor reactor;
+
+  SECTION("periodic timer ticks until stopped") {
+    int ticks = 0;
+    reactor.add_timer(5ms, [&] {
+      if (++ticks==3) {
+        reactor.stop();
+      }
+    });
+    auto start = std::chrono::steady_clock::now();
+    reactor.run();
+    REQUIRE(ticks==3);
+    REQUIRE(std::chrono::steady_clock::now() - start >= 15ms);
+  }
+
+  SECTION("deadline fires once at the armed time and can be re-armed") {
+    int fired = 0;
+    auto start = std::chrono::steady_clock::now();
+    int deadline = -1;
+    deadline = reactor.add_deadline([&] {
+      if (++fired==2) {
+        reactor.stop();
+        return;
+      }
+      reactor.arm(deadline, std::chrono::steady_clock::now() + 5ms);
+    });
+    reactor.arm(deadline, start + 10ms);
+    reactor.run();
+    REQUIRE(fired==2);
+    REQUIRE(std::chrono::steady_clock::now() - start >= 15ms);
+  }
+
+  SECTION("deadline in the past fires right away") {
+    auto deadline = reactor.add_deadline([&] { reactor.stop(); });
+    reactor.arm(deadline, std::chrono::steady_clock::now() - 1s);
+    reactor.run();
+    REQUIRE(reactor.stopped());
+  }
+}
+
+TEST_CASE("Reactor stops from another thread", "[reactor]") {
+  gossip::Reactor reactor;
+  std::thread t([&] { reactor.run(); });
+  std::this_thread::sleep_for(10ms);
+  reactor.stop();
+  t.join();
+  REQUIRE(reactor.stopped());
+
+  // A stopped reactor returns at once
+  reactor.run();
+}
+
+TEST_CASE("Reactor drains a listener socket", "[reactor]") {
+  gossip::Reactor reactor;
+  gossip::ListenerPool pool{1, 8, 1024};
+  std::vector<std::vector<gossip::Peer>> actual;
+  pool.start(reactor, "127.0.0.1", "5030", 1 << 20, [&](const char *buf, std::size_t len) {
+    actual.push_back(gossip::Listener::deserialize(buf, len));
+    if (actual.size()==3) {
+      reactor.stop();
+    }
+  });
+
+  gossip::Client client{"123", 2};
+  std::vector<gossip::Peer> peers{gossip::Peer{"123", "127.0.0.1:5000"}};
+  msgpack::sbuffer ss;
+  auto s = client.serialize(ss, peers);
+  REQUIRE(client.send_members(ss.data(), s, {"127.0.0.1:5030", "127.0.0.1:5030", "127.0.0.1:5030"})==3);
+
+  // Gives up when nothing arrives instead of blocking forever
+  auto timeout = reactor.add_deadline([&] { reactor.stop(); });
+  reactor.arm(timeout, std::chrono::steady_clock::now() + 2s);
+  reactor.run();
+  pool.stop();
+
+  REQUIRE(actual.size()==3);
+  for (const auto &a : actual) {
+    REQUIRE(a==peers);
+  }
+  REQUIRE(pool.received()==3);
+  REQUIRE(pool.bytes_received()==3*s);
+}
@@ -0,0 +1,71 @@
+#include <catch2/catch.hpp>
+#include <cstdlib>
+#include <new>
+#include <unistd.h>
+#include <Client.hpp>
+#include <Listener.hpp>
+
+// Counts heap allocations made by the calling thread, so other test threads do not interfere.
+namespace {
+thread_local std::size_t allocations = 0;
+} // namespace
+
+void *operator new(std::size_t size) {
+  ++allocations;
+  if (auto p = std::malloc(size)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept {
+  std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept {
+  std::free(p);
+}
+
+TEST_CASE("Steady state gossip round does not allocate", "[round]") {
+  gossip::Listener server;
+  auto sink = server.create_connection("127.0.0.1", "5010");
+
+  gossip::Members members{};
+  // Every id has the same length, a peer copied over a slot that held another one
+  // always fits in its capacity whichever peers the sampler picked
+  gossip::Peer me{"node-me.gspd.cluster.local", "127.0.0.1:5010"};
+  members.set_me(me.get_id());
+  members.add_peer(me);
+  for (int i = 0; i < 64; ++i) {
+    auto n = std::to_string(i);
+    n.insert(0, 2 - n.size(), '0');
+    gossip::Peer p{"node-" + n + ".gspd.cluster.local", "127.0.0.1:5010"};
+    members.add_peer(p);
+  }
+
+  // Same steps as the sender thread in app.cpp in full table mode
+  gossip::Client client{};
+  std::vector<gossip::Peer> k;
+  std::vector<gossip::Peer> table;
+  msgpack::sbuffer sbuf;
+  auto round = [&] {
+    members.get_random_peers(3, k);
+    members.beat();
+    members.get_alive_peers(table);
+    return client.send_table(sbuf, table, k, gossip::MAX_DATAGRAM);
+  };
+
+  // Warm up buffers, endpoint cache and the sampler
+  round();
+  round();
+  int sent = 0;
+  auto before = allocations;
+  for (int i = 0; i < 100; ++i) {
+    sent += round();
+  }
+  auto after = allocations;
+
+  ::close(sink);
+  REQUIRE(sent >= 300);
+  REQUIRE(after==before);
+}
@@ -0,0 +1,84 @@
+#include <chrono>
+#include <catch2/catch.hpp>
+#include "Simulator.hpp"
+
+using namespace std::chrono_literals;
+
+namespace {
+gossip::sim::Options small(std::uint64_t seed) {
+  gossip::sim::Options o;
+  o.nodes = 40;
+  o.seed = seed;
+  return o;
+}
+} // namespace
+
+TEST_CASE("A seed replays the same simulation", "[simulator]") {
+  auto a = gossip::sim::Cluster(small(7)).run(3s);
+  auto b = gossip::sim::Cluster(small(7)).run(3s);
+  REQUIRE(!a.convergence.empty());
+  REQUIRE(a.convergence==b.convergence);
+  REQUIRE(a.datagrams==b.datagrams);
+  REQUIRE(a.bytes==b.bytes);
+
+  auto c = gossip::sim::Cluster(small(8)).run(3s);
+  REQUIRE(c.convergence!=a.convergence);
+}
+
+// Short deadlines on a lossy network, so suspicions and removals of live and crashed
+// nodes, whose timers are rounded to the wheel ticks, are part of the replay
+TEST_CASE("A seed replays the same lossy simulation", "[simulator]") {
+  auto o = small(5);
+  o.loss = 0.3;
+  o.jitter = 5ms;
+  o.tfail = 300;
+  o.tclean = 500;
+  auto run = [&o] {
+    gossip::sim::Cluster cluster(o);
+    cluster.crash(3, 500ms);
+    return cluster.run(3s);
+  };
+  auto a = run();
+  auto b = run();
+  REQUIRE(a.suspicions > 0);
+  REQUIRE(a.removals > 0);
+  REQUIRE(a.suspicions==b.suspicions);
+  REQUIRE(a.false_suspicions==b.false_suspicions);
+  REQUIRE(a.removals==b.removals);
+  REQUIRE(a.detection==b.detection);
+  REQUIRE(a.convergence==b.convergence);
+  REQUIRE(a.lost==b.lost);
+  REQUIRE(a.bytes==b.bytes);
+}
+
+TEST_CASE("Lossless cluster converges and detects a crash without false positives", "[simulator]") {
+  gossip::sim::Cluster cluster(small(1));
+  cluster.crash(3, 1s);
+  auto r = cluster.run(4s);
+
+  REQUIRE(r.increments > 0);
+  REQUIRE(r.convergence.size() > r.increments/2);
+  REQUIRE(gossip::sim::Report::percentile(r.convergence, 0.99) < 1000);
+  REQUIRE(r.false_suspicions==0);
+  REQUIRE(r.false_positive_rate==0);
+  REQUIRE(r.detection.size()==1);
+  REQUIRE(r.detection[0] >= 1000);
+  REQUIRE(r.detection[0] < 2000);
+  REQUIRE(r.lost==0);
+  REQUIRE(r.bytes_per_node_per_second > 0);
+  REQUIRE(r.dissemination_hops >= 1);
+  REQUIRE(cluster.node(0).is_alive("node-1"));
+  REQUIRE(!cluster.node(0).is_alive("node-3"));
+}
+
+TEST_CASE("Lossy cluster still converges", "[simulator]") {
+  auto o = small(3);
+  o.loss = 0.2;
+  o.jitter = 5ms;
+  auto r = gossip::sim::Cluster(o).run(3s);
+
+  REQUIRE(r.lost > 0);
+  REQUIRE(r.lost < r.datagrams);
+  REQUIRE(!r.convergence.empty());
+  REQUIRE(r.false_positive_rate < 0.01);
+}
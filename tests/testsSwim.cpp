@@ -0,0 +1,162 @@
+#include <poll.h>
+#include <unistd.h>
+#include <catch2/catch.hpp>
+#include "gossip.hpp"
+#include "Listener.hpp"
+#include "Swim.hpp"
+
+using namespace std::chrono_literals;
+
+namespace {
+// One node listening on a loopback port, driven by the cluster clock.
+struct Node {
+  std::string id;
+  gossip::Members members;
+  gossip::Listener listener{16, gossip::MAX_DATAGRAM};
+  int fd{-1};
+  bool up{true};
+  std::unique_ptr<gossip::Swim> swim;
+};
+
+// In-process cluster on loopback sockets. Time only moves in step, which ticks every
+// node that is up and then delivers datagrams until no socket has any left, so runs
+// are deterministic up to the random choice of probe targets.
+class Cluster {
+public:
+  Cluster(int size, int base_port, gossip::Swim::Options options) {
+    for (int i = 0; i < size; ++i) {
+      auto n = std::make_unique<Node>();
+      n->id = "n" + std::to_string(i);
+      auto address = "127.0.0.1:" + std::to_string(base_port + i);
+      n->members.set_clock([this] { return now_; });
+      n->members.set_me(n->id);
+      gossip::Peer me{n->id, address};
+      n->members.add_peer(me);
+      if (i > 0) {
+        gossip::Peer seed{"n0", "127.0.0.1:" + std::to_string(base_port)};
+        n->members.add_peer(seed);
+      }
+      n->fd = n->listener.create_connection("127.0.0.1", std::to_string(base_port + i), 1 << 20);
+      n->swim = std::make_unique<gossip::Swim>(n->members, n->id, address, options);
+      nodes_.push_back(std::move(n));
+    }
+  }
+
+  ~Cluster() {
+    for (auto &n : nodes_) {
+      if (n->fd >= 0) {
+        ::close(n->fd);
+      }
+    }
+  }
+
+  Node &operator[](std::size_t i) {
+    return *nodes_[i];
+  }
+
+  void run(std::chrono::milliseconds duration) {
+    for (auto end = now_ + duration; now_ < end;) {
+      now_ += 10ms;
+      for (auto &n : nodes_) {
+        if (n->up) {
+          n->swim->tick(now_);
+        }
+      }
+      deliver();
+    }
+  }
+
+  // Closes the socket of node i and stops driving it.
+  void crash(std::size_t i) {
+    nodes_[i]->up = false;
+    ::close(nodes_[i]->fd);
+    nodes_[i]->fd = -1;
+  }
+
+  bool all_up_see(const std::string &id, bool alive) {
+    for (auto &n : nodes_) {
+      if (n->up && n->id!=id && n->members.is_alive(id)!=alive) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+private:
+  std::vector<std::unique_ptr<Node>> nodes_;
+  std::chrono::steady_clock::time_point now_{std::chrono::steady_clock::now()};
+
+  void deliver() {
+    bool any = true;
+    while (any) {
+      any = false;
+      for (auto &n : nodes_) {
+        if (!n->up) {
+          continue;
+        }
+        pollfd p{n->fd, POLLIN, 0};
+        while (poll(&p, 1, 0) > 0) {
+          n->listener.listen_gossip_batch(n->fd, [&](const char *buf, std::size_t len) {
+            n->swim->receive(buf, len, now_);
+          });
+          any = true;
+        }
+      }
+    }
+  }
+};
+
+gossip::Swim::Options options() {
+  gossip::Swim::Options o;
+  o.period = 100ms;
+  o.ack_timeout = 40ms;
+  o.suspicion = 1000ms;
+  return o;
+}
+} // namespace
+
+TEST_CASE("Swim members join through a seed", "[swim]") {
+  Cluster cluster{5, 5400, options()};
+  cluster.run(3s);
+  for (int i = 0; i < 5; ++i) {
+    REQUIRE(cluster[i].members.size()==5);
+    // One probe per period whatever the cluster size
+    REQUIRE(cluster[i].swim->probes() <= 31);
+  }
+}
+
+TEST_CASE("Swim confirms a crashed member everywhere", "[swim]") {
+  Cluster cluster{5, 5410, options()};
+  cluster.run(3s);
+  REQUIRE(cluster[0].members.size()==5);
+
+  cluster.crash(4);
+  cluster.run(3s);
+  std::uint64_t indirect = 0;
+  std::uint64_t suspicions = 0;
+  for (int i = 0; i < 4; ++i) {
+    REQUIRE(cluster[i].members.size()==4);
+    REQUIRE_FALSE(cluster[i].members.is_dead("n4"));
+    indirect += cluster[i].swim->indirect_probes();
+    suspicions += cluster[i].swim->suspicions();
+  }
+  REQUIRE(indirect > 0);
+  REQUIRE(suspicions > 0);
+}
+
+TEST_CASE("Swim member refutes its suspicion", "[swim]") {
+  Cluster cluster{5, 5420, options()};
+  cluster.run(3s);
+  REQUIRE(cluster[0].members.size()==5);
+
+  // Paused long enough to be suspected, its socket queues what it misses
+  cluster[4].up = false;
+  cluster.run(400ms);
+  cluster[4].up = true;
+  cluster.run(2s);
+  REQUIRE(cluster.all_up_see("n4", true));
+  REQUIRE(cluster[4].swim->incarnation() >= 1);
+  for (int i = 0; i < 5; ++i) {
+    REQUIRE(cluster[i].members.size()==5);
+  }
+}
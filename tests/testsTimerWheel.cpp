@@ -0,0 +1,119 @@
+#include <catch2/catch.hpp>
+#include <TimerWheel.hpp>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+// A timer fires at the first advance at least one tick past its deadline
+TEST_CASE("Timer wheel fires timers by deadline", "[timer]") {
+  timer::TimerWheel wheel{10ms, 8};
+  auto start = timer::TimerWheel::clock::now();
+  std::vector<timer::TimerWheel::id_t> fired;
+  auto collect = [&](timer::TimerWheel::id_t id) { fired.push_back(id); };
+
+  SECTION("only due timers fire, never early") {
+    wheel.schedule(1, start + 20ms);
+    wheel.schedule(2, start + 50ms);
+    REQUIRE(wheel.size()==2);
+    REQUIRE(wheel.advance(start + 10ms, collect)==0);
+    REQUIRE(wheel.advance(start + 40ms, collect)==1);
+    REQUIRE(fired==std::vector<timer::TimerWheel::id_t>{1});
+    REQUIRE_FALSE(wheel.scheduled(1));
+    REQUIRE(wheel.scheduled(2));
+    REQUIRE(wheel.advance(start + 70ms, collect)==1);
+    REQUIRE(wheel.size()==0);
+  }
+
+  SECTION("cancel and reschedule by id") {
+    wheel.schedule(1, start + 20ms);
+    wheel.schedule(2, start + 20ms);
+    wheel.cancel(1);
+    wheel.schedule(2, start + 40ms);
+    REQUIRE(wheel.size()==1);
+    REQUIRE(wheel.advance(start + 30ms, collect)==0);
+    REQUIRE(wheel.advance(start + 50ms, collect)==1);
+    REQUIRE(fired==std::vector<timer::TimerWheel::id_t>{2});
+  }
+
+  SECTION("deadlines past one turn of the wheel wait their round") {
+    wheel.schedule(3, start + 250ms);
+    REQUIRE(wheel.advance(start + 100ms, collect)==0);
+    REQUIRE(wheel.advance(start + 200ms, collect)==0);
+    REQUIRE(wheel.advance(start + 270ms, collect)==1);
+  }
+
+  SECTION("a late advance fires everything due and a past deadline fires next") {
+    for (timer::TimerWheel::id_t id = 0; id < 100; ++id) {
+      wheel.schedule(id, start + std::chrono::milliseconds(id*10));
+    }
+    REQUIRE(wheel.advance(start + 2s, collect)==100);
+    wheel.schedule(7, start);
+    REQUIRE(wheel.advance(start + 2s, collect)==0);
+    REQUIRE(wheel.advance(start + 2020ms, collect)==1);
+  }
+
+  SECTION("callbacks may schedule again") {
+    wheel.schedule(1, start + 10ms);
+    wheel.advance(start + 20ms, [&](timer::TimerWheel::id_t id) { wheel.schedule(id, start + 30ms); });
+    REQUIRE(wheel.scheduled(1));
+    REQUIRE(wheel.advance(start + 40ms, collect)==1);
+  }
+
+  SECTION("next deadline is the earliest armed timer") {
+    wheel.schedule(1, start + 250ms);
+    wheel.schedule(2, start + 40ms);
+    REQUIRE(wheel.next_deadline() >= start + 40ms);
+    REQUIRE(wheel.next_deadline() < start + 60ms);
+    wheel.cancel(2);
+    REQUIRE(wheel.next_deadline() < start + 80ms + 10ms);
+    wheel.schedule(3, start + 20ms);
+    REQUIRE(wheel.next_deadline() < start + 30ms);
+    wheel.advance(start + 200ms, collect);
+    REQUIRE(wheel.next_deadline() >= start + 250ms);
+    REQUIRE(wheel.next_deadline() < start + 270ms);
+  }
+
+  SECTION("schedule reports timers due before the watched deadline") {
+    REQUIRE_FALSE(wheel.schedule(1, start + 50ms));
+    auto next = wheel.watch();
+    REQUIRE(next >= start + 50ms);
+    REQUIRE(next < start + 60ms);
+    REQUIRE_FALSE(wheel.schedule(2, start + 70ms));
+    REQUIRE(wheel.schedule(3, start + 20ms));
+    REQUIRE_FALSE(wheel.schedule(4, start + 30ms));
+    REQUIRE(wheel.watch() < start + 30ms);
+  }
+}
+
+TEST_CASE("Timer wheel rounds deadlines against its start", "[timer]") {
+  auto start = timer::TimerWheel::clock::now();
+  timer::TimerWheel wheel{10ms, 8, start};
+  auto none = [](timer::TimerWheel::id_t) {};
+  wheel.schedule(1, start + 25ms);
+  REQUIRE(wheel.next_deadline()==start + 30ms);
+  wheel.cancel(1);
+
+  wheel.restart(start + 5ms);
+  wheel.schedule(1, start + 25ms);
+  REQUIRE(wheel.next_deadline()==start + 25ms);
+  REQUIRE(wheel.advance(start + 24ms, none)==0);
+  REQUIRE(wheel.advance(start + 25ms, none)==1);
+}
+
+TEST_CASE("Timer wheel wait wakes up for earlier timers", "[timer]") {
+  timer::TimerWheel wheel{1ms, 1024};
+  std::atomic<bool> done{false};
+  std::thread waiter([&] {
+    wheel.wait();
+    done.store(true);
+  });
+  std::this_thread::sleep_for(20ms);
+  REQUIRE_FALSE(done.load());
+  auto scheduled = timer::TimerWheel::clock::now();
+  wheel.schedule(1, scheduled + 10ms);
+  waiter.join();
+  REQUIRE(timer::TimerWheel::clock::now() >= scheduled + 10ms);
+  REQUIRE(wheel.advance(timer::TimerWheel::clock::now(), [](timer::TimerWheel::id_t) {})==1);
+}